@@ -0,0 +1,137 @@
+#include "BoneTrack.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// the three smallest components of a unit quaternion lie within +-1/sqrt(2)
+static const float SmallestThreeRange = 0.707106781f;
+// (an even number of steps, so that 0 is exact)
+static const float RotationQuantum = 32766.0f;
+static const float TranslationQuantum = 65535.0f;
+
+// (a, b, c, dropped) -> quaternion, by index of the dropped component
+static const uint32_t SmallestThreeSwizzle[4][4] = {
+    { 3, 0, 1, 2 },
+    { 0, 3, 1, 2 },
+    { 0, 1, 3, 2 },
+    { 0, 1, 2, 3 }
+};
+
+// value in [0, 1] -> [0, quantum]
+static inline unsigned short Quantize(float value, float quantum)
+{
+    return static_cast<unsigned short>(std::min(std::max(std::floor(value * quantum + 0.5f), 0.0f), quantum));
+}
+
+static inline XMVECTOR DecodeRotation(const BoneTrack::Key& key)
+{
+    const XMVECTOR scale = XMVectorReplicate(2.0f * SmallestThreeRange / RotationQuantum);
+    const XMVECTOR bias = XMVectorReplicate(-SmallestThreeRange);
+    const uint32_t dropped = ((key.rotation[0] >> 15) << 1) | (key.rotation[1] >> 15);
+    XMVECTOR v = XMVectorSet(static_cast<float>(key.rotation[0] & 0x7fff),
+        static_cast<float>(key.rotation[1] & 0x7fff), static_cast<float>(key.rotation[2]), 0);
+    v = XMVectorMultiplyAdd(v, scale, bias);
+    // the dropped component is positive, so it follows from the unit length
+    const XMVECTOR w = XMVectorSqrt(XMVectorMax(XMVectorSubtract(XMVectorSplatOne(), XMVector3Dot(v, v)), XMVectorZero()));
+    v = XMVectorPermute(v, w, 0, 1, 2, 7);
+    const uint32_t* swizzle = SmallestThreeSwizzle[dropped];
+    return XMVectorSwizzle(v, swizzle[0], swizzle[1], swizzle[2], swizzle[3]);
+}
+
+static inline XMVECTOR DecodeTranslation(const BoneTrack::Key& key, FXMVECTOR minimum, FXMVECTOR step)
+{
+    const XMVECTOR v = XMVectorSet(static_cast<float>(key.translation[0]),
+        static_cast<float>(key.translation[1]), static_cast<float>(key.translation[2]), 0);
+    return XMVectorMultiplyAdd(v, step, minimum);
+}
+
+void BoneTrack::Compress(const RigidTransform* boneTrans, int numBones_, int numFrames_)
+{
+    numBones = numBones_;
+    numFrames = numFrames_;
+    keys.resize(numFrames * numBones);
+    translationRange.resize(numBones * 2);
+    error = ErrorBound();
+
+    for (int b = 0; b < numBones; ++b)
+    {
+        XMVECTOR minimum = XMVectorReplicate(FLT_MAX), maximum = XMVectorReplicate(-FLT_MAX);
+        for (int f = 0; f < numFrames; ++f)
+        {
+            const XMVECTOR t = XMLoadFloat3A(&boneTrans[f * numBones + b].Translation());
+            minimum = XMVectorMin(minimum, t);
+            maximum = XMVectorMax(maximum, t);
+        }
+        minimum = XMVectorSetW(minimum, 0);
+        const XMVECTOR step = XMVectorSetW(XMVectorScale(XMVectorSubtract(maximum, minimum), 1.0f / TranslationQuantum), 0);
+        XMStoreFloat4A(&translationRange[b * 2 + 0], minimum);
+        XMStoreFloat4A(&translationRange[b * 2 + 1], step);
+        error.translationStep = std::max(error.translationStep, 0.5f * XMVectorGetX(XMVector3Length(step)));
+
+        XMFLOAT4A m, invExtent;
+        XMStoreFloat4A(&m, minimum);
+        XMStoreFloat4A(&invExtent, XMVectorSubtract(maximum, minimum));
+        invExtent.x = (invExtent.x > 0) ? 1.0f / invExtent.x : 0;
+        invExtent.y = (invExtent.y > 0) ? 1.0f / invExtent.y : 0;
+        invExtent.z = (invExtent.z > 0) ? 1.0f / invExtent.z : 0;
+
+        for (int f = 0; f < numFrames; ++f)
+        {
+            const RigidTransform& rt = boneTrans[f * numBones + b];
+            Key& key = keys[f * numBones + b];
+
+            // smallest three
+            XMFLOAT4A q;
+            XMStoreFloat4A(&q, XMQuaternionNormalize(XMLoadFloat4A(&rt.Rotation())));
+            float c[4] = { q.x, q.y, q.z, q.w };
+            int dropped = 0;
+            for (int i = 1; i < 4; ++i)
+            {
+                if (std::abs(c[i]) > std::abs(c[dropped]))
+                {
+                    dropped = i;
+                }
+            }
+            const float sign = (c[dropped] < 0) ? -1.0f : 1.0f;
+            unsigned short u[3];
+            for (int i = 0, j = 0; i < 4; ++i)
+            {
+                if (i != dropped)
+                {
+                    u[j++] = Quantize((sign * c[i] + SmallestThreeRange) * (0.5f / SmallestThreeRange), RotationQuantum);
+                }
+            }
+            key.rotation[0] = static_cast<unsigned short>(u[0] | ((dropped >> 1) << 15));
+            key.rotation[1] = static_cast<unsigned short>(u[1] | ((dropped & 1) << 15));
+            key.rotation[2] = u[2];
+
+            const XMFLOAT3A& t = rt.Translation();
+            key.translation[0] = Quantize((t.x - m.x) * invExtent.x, TranslationQuantum);
+            key.translation[1] = Quantize((t.y - m.y) * invExtent.y, TranslationQuantum);
+            key.translation[2] = Quantize((t.z - m.z) * invExtent.z, TranslationQuantum);
+
+            // measured error of this key
+            // (angle from the chord between the unit quaternions; acos is too coarse near 1)
+            const XMVECTOR qd = DecodeRotation(key);
+            const XMVECTOR qs = XMVectorScale(XMLoadFloat4A(&q), sign);
+            const float chord = XMVectorGetX(XMVector4Length(XMVectorSubtract(qd, qs)));
+            error.rotation = std::max(error.rotation, 4.0f * std::asin(std::min(0.5f * chord, 1.0f)));
+            const XMVECTOR dt = XMVectorSubtract(DecodeTranslation(key, minimum, step), XMLoadFloat3A(&t));
+            error.translation = std::max(error.translation, XMVectorGetX(XMVector3Length(dt)));
+        }
+    }
+}
+
+void BoneTrack::DecodeFrame(RigidTransform* boneTrans, int frame) const
+{
+    const Key* frameKeys = &keys[frame * numBones];
+    for (int b = 0; b < numBones; ++b)
+    {
+        const XMVECTOR minimum = XMLoadFloat4A(&translationRange[b * 2 + 0]);
+        const XMVECTOR step = XMLoadFloat4A(&translationRange[b * 2 + 1]);
+        XMStoreFloat4A(&boneTrans[b].Rotation(), DecodeRotation(frameKeys[b]));
+        XMStoreFloat3A(&boneTrans[b].Translation(), DecodeTranslation(frameKeys[b], minimum, step));
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef BONE_TRACK_H
+#define BONE_TRACK_H
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "RigidTransform.h"
+
+// Compressed bone animation (numFrames x numBones keys, 12 bytes per key).
+//
+// Rotations are stored in smallest-three form: the largest-magnitude
+// component is dropped (and made positive), the remaining three lie in
+// [-1/sqrt(2), 1/sqrt(2)] and are quantised to 15 bits each. The 2-bit index
+// of the dropped component lives in the top bits of the first two words.
+// Translations are quantised to 16 bits per component against the range of
+// each bone over the clip.
+class BoneTrack
+{
+public:
+    struct Key
+    {
+        unsigned short rotation[3];
+        unsigned short translation[3];
+    };
+    struct ErrorBound
+    {
+        //! largest rotation error over all keys (radians)
+        float rotation;
+        //! largest translation error over all keys
+        float translation;
+        //! largest translation error the quantisation step allows
+        float translationStep;
+
+        ErrorBound()
+            : rotation(0), translation(0), translationStep(0)
+        {
+        }
+        // worst-case displacement of a bind-pose point within radius of the origin
+        float Displacement(float radius) const
+        {
+            return rotation * radius + translation;
+        }
+    };
+
+public:
+    BoneTrack()
+        : numBones(0), numFrames(0)
+    {
+    }
+
+public:
+    // boneTrans is numFrames x numBones (the SSDR::Output layout)
+    void Compress(const RigidTransform* boneTrans, int numBones, int numFrames);
+    // decodes the pose of every bone in a frame into boneTrans[0 .. numBones)
+    void DecodeFrame(RigidTransform* boneTrans, int frame) const;
+
+    const ErrorBound& Error() const
+    {
+        return error;
+    }
+    int NumBones() const
+    {
+        return numBones;
+    }
+    int NumFrames() const
+    {
+        return numFrames;
+    }
+    size_t SizeInBytes() const
+    {
+        return keys.size() * sizeof(Key) + translationRange.size() * sizeof(DirectX::XMFLOAT4A);
+    }
+
+private:
+    std::vector<Key> keys;
+    // per bone: minimum, then step, of the translation range
+    std::vector<DirectX::XMFLOAT4A> translationRange;
+    ErrorBound error;
+    int numBones;
+    int numFrames;
+};
+
+#endif //BONE_TRACK_H
@@ -0,0 +1,156 @@
+#include "FrameLoader.h"
+#include <algorithm>
+#include "util.h"
+
+using namespace DirectX;
+
+// sequence frames are read in chunks of about this size
+static const unsigned long long ChunkBytes = 4ULL * 1024 * 1024;
+
+FrameLoader::FrameLoader()
+    : frames(nullptr), isSequence(false), scale(1.0f),
+    numFrames(0), numVertices(0), framesPerChunk(1),
+    nextFrame(0), failed(false)
+{
+}
+
+FrameLoader::~FrameLoader()
+{
+    WaitAll();
+}
+
+unsigned int FrameLoader::CountObjFiles(const std::wstring& framePathFormat)
+{
+    wchar_t pathBuf[1024];
+    unsigned int count = 0;
+    for (;; ++count)
+    {
+        swprintf_s(pathBuf, framePathFormat.data(), count + 1);
+        if (GetFileAttributesW(pathBuf) == INVALID_FILE_ATTRIBUTES)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+bool FrameLoader::StartSequence(XMFLOAT3* frames_, const MeshSequenceHeader& header_, const std::wstring& filePath_, unsigned int numWorkers)
+{
+    if (!workers.empty() || header_.numFrames == 0)
+    {
+        return false;
+    }
+    frames = frames_;
+    header = header_;
+    filePath = filePath_;
+    isSequence = true;
+    numFrames = header.numFrames;
+    numVertices = header.numVertices;
+    framesPerChunk = static_cast<unsigned int>(std::max<unsigned long long>(1, ChunkBytes / std::max<unsigned long long>(1, header.FrameSize())));
+    Launch(numWorkers);
+    return true;
+}
+
+bool FrameLoader::StartObjFiles(XMFLOAT3* frames_, unsigned int numFrames_, unsigned int numVertices_, const std::wstring& framePathFormat, float scale_, unsigned int numWorkers)
+{
+    if (!workers.empty() || numFrames_ == 0)
+    {
+        return false;
+    }
+    frames = frames_;
+    filePath = framePathFormat;
+    isSequence = false;
+    scale = scale_;
+    numFrames = numFrames_;
+    numVertices = numVertices_;
+    framesPerChunk = 1;
+    Launch(numWorkers);
+    return true;
+}
+
+void FrameLoader::Launch(unsigned int numWorkers)
+{
+    if (numWorkers == 0)
+    {
+        numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const unsigned int numChunks = (numFrames + framesPerChunk - 1) / framesPerChunk;
+    numWorkers = std::min(numWorkers, numChunks);
+
+    ready.assign(numFrames, 0);
+    failed = false;
+    nextFrame = 0;
+    for (unsigned int i = 0; i < numWorkers; ++i)
+    {
+        workers.push_back(std::thread(&FrameLoader::Work, this));
+    }
+}
+
+void FrameLoader::Work()
+{
+    for (;;)
+    {
+        const unsigned int first = nextFrame.fetch_add(framesPerChunk);
+        if (first >= numFrames)
+        {
+            break;
+        }
+        const unsigned int count = std::min(framesPerChunk, numFrames - first);
+        const bool loaded = LoadChunk(first, count);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (loaded)
+        {
+            std::fill(ready.begin() + first, ready.begin() + first + count, 1);
+        }
+        else
+        {
+            failed = true;
+        }
+        condition.notify_all();
+    }
+}
+
+bool FrameLoader::LoadChunk(unsigned int firstFrame, unsigned int numChunkFrames)
+{
+    XMFLOAT3* dst = frames + static_cast<size_t>(firstFrame) * numVertices;
+    if (isSequence)
+    {
+        return ReadMeshSequenceFrames(dst, header, filePath, firstFrame, numChunkFrames);
+    }
+
+    wchar_t pathBuf[1024];
+    std::vector<XMFLOAT3A> position;
+    std::vector<DWORD> index;
+    for (unsigned int f = 0; f < numChunkFrames; ++f)
+    {
+        swprintf_s(pathBuf, filePath.data(), firstFrame + f + 1);
+        if (!LoadObjFile(position, index, pathBuf, scale) || position.size() != numVertices)
+        {
+            return false;
+        }
+        std::copy(position.begin(), position.end(), dst + static_cast<size_t>(f) * numVertices);
+    }
+    return true;
+}
+
+bool FrameLoader::WaitFrame(unsigned int frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (frame >= ready.size())
+    {
+        return false;
+    }
+    condition.wait(lock, [&] { return ready[frame] != 0 || failed; });
+    return ready[frame] != 0;
+}
+
+bool FrameLoader::WaitAll()
+{
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        it->join();
+    }
+    workers.clear();
+    return !failed;
+}
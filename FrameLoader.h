@@ -0,0 +1,60 @@
+#ifndef FRAME_LOADER_H
+#define FRAME_LOADER_H
+#pragma once
+
+#include <DirectXMath.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MeshSequence.h"
+
+// Loads animation frames on background workers straight into a caller-owned
+// position buffer (e.g. SSDR::Input::sample). Frames are claimed in order,
+// so early frames become available first and can be consumed through
+// WaitFrame() while later ones are still being read.
+class FrameLoader
+{
+public:
+    FrameLoader();
+    ~FrameLoader();
+
+public:
+    bool StartSequence(DirectX::XMFLOAT3* frames, const MeshSequenceHeader& header, const std::wstring& filePath, unsigned int numWorkers = 0);
+    bool StartObjFiles(DirectX::XMFLOAT3* frames, unsigned int numFrames, unsigned int numVertices, const std::wstring& framePathFormat, float scale = 1.0f, unsigned int numWorkers = 0);
+    bool WaitFrame(unsigned int frame);
+    bool WaitAll();
+
+public:
+    static unsigned int CountObjFiles(const std::wstring& framePathFormat);
+
+private:
+    void Launch(unsigned int numWorkers);
+    void Work();
+    bool LoadChunk(unsigned int firstFrame, unsigned int numChunkFrames);
+
+private:
+    DirectX::XMFLOAT3* frames;
+    std::wstring filePath;
+    MeshSequenceHeader header;
+    bool isSequence;
+    float scale;
+    unsigned int numFrames;
+    unsigned int numVertices;
+    unsigned int framesPerChunk;
+
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> nextFrame;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<unsigned char> ready;
+    bool failed;
+
+private:
+    FrameLoader(const FrameLoader& src);
+    void operator =(const FrameLoader& src);
+};
+
+#endif //FRAME_LOADER_H
@@ -1,10 +1,25 @@
 #include "HorseObject.h"
 #include <d3dcompiler.h>
+#include <algorithm>
 #include "util.h"
+#include "MeshSequence.h"
+#include "FrameLoader.h"
+#include "Skinning.h"
+#include "KeyframeAnimation.h"
 #include "SSDR.h"
+#include "WeightCodec.h"
 
 using namespace DirectX;
 
+// reconstruction error mapped to full red
+static const float ErrorColorUpperBound = 0.05f;
+// vertex-space tolerance of the keyframe reduction
+static const float KeyframeTolerance = 0.001f;
+// source OBJ sequence and its packed cache
+static const wchar_t* ReferencePath = L"./data/horse-gallop-reference.obj";
+static const wchar_t* ObjPathFormat = L"./data/horse-gallop-%02d.obj";
+static const wchar_t* SequencePath = L"./data/horse-gallop.mseq";
+
 HRESULT CompileShaderFromFile(std::wstring fileName, char* entryPoint, char* shaderModel, ID3DBlob*& blob)
 {
     HRESULT hr = S_OK;
@@ -58,6 +73,7 @@ HorseObject::HorseObject()
     inputLayout(nullptr),
     vertexShader(nullptr), pixelShader(nullptr), alphaBlendState(nullptr),
     vertexBuffer(nullptr), indexBuffer(nullptr), numVertices(0), numFaces(0),
+    errorTableBuffer(nullptr), errorTableView(nullptr),
     vertexBufferCPU(nullptr), srcVertexBufferCPU(nullptr), numFrames(0), frame(0)
 {
 }
@@ -258,46 +274,58 @@ HRESULT HorseObject::LoadModel(ID3D11Device* device, const wchar_t* filePath, co
         assert(false && "ID3D11Device::CreateBuffer() Failed.");
         return false;
     }
+    faceIndex.swap(index);
 
     return hr;
 }
 
-bool HorseObject::LoadAnim(const wchar_t* filePath)
+HRESULT HorseObject::CreateErrorTable(ID3D11Device* device)
 {
-    bool retval = true;
-    wchar_t pathBuf[1024];
-    numFrames = 1;
-    for (;; ++numFrames)
+    // reconstruction error of every frame as it is played back, i.e. with the poses
+    // decoded from the compressed bone track, computed once and quantised to 8 bits
+    std::vector<RigidTransform> decodedAnim(static_cast<size_t>(numFrames) * numBones);
+    for (unsigned long f = 0; f < numFrames; ++f)
     {
-        swprintf_s(pathBuf, filePath, numFrames);
-        if (GetFileAttributesW(pathBuf) == -1)
-        {
-            --numFrames;
-            break;
-        }
+        boneTrack.DecodeFrame(decodedAnim.data() + f * numBones, f);
     }
-    vertexAnim.resize(numFrames * numVertices);
+    std::vector<unsigned char> table;
+    ComputeSkinningErrorTable(table, ErrorColorUpperBound, bindModel.data(), skinWeight.data(), skinIndex.data(),
+        CustomVertex::NumInfluences, numVertices, decodedAnim.data(), numBones, vertexAnim.data(), numFrames);
 
-    std::vector<XMFLOAT3A> position, normal;
-    std::vector<DWORD> index;
-    for (unsigned long f = 0; f < numFrames; ++f)
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(D3D11_BUFFER_DESC));
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.ByteWidth = static_cast<UINT>(table.size());
+    bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    bd.CPUAccessFlags = 0;
+    D3D11_SUBRESOURCE_DATA initData;
+    ZeroMemory(&initData, sizeof(D3D11_SUBRESOURCE_DATA));
+    initData.pSysMem = table.data();
+    HRESULT hr = device->CreateBuffer(&bd, &initData, &errorTableBuffer);
+    if (FAILED(hr))
     {
-        swprintf_s(pathBuf, filePath, f + 1);
-        retval = LoadObjFile(position, index, pathBuf, 1.0f);
-        if (!retval)
-        {
-            break;
-        }
-        for (unsigned long v = 0; v < numVertices; ++v)
-        {
-            vertexAnim[f * numVertices + v] = position[v];
-        }
+        assert(false && "ID3D11Device::CreateBuffer() Failed.");
+        return hr;
     }
-    if (!retval)
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory(&srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+    srvDesc.Format = DXGI_FORMAT_R8_UNORM;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.FirstElement = 0;
+    srvDesc.Buffer.NumElements = static_cast<UINT>(table.size());
+    hr = device->CreateShaderResourceView(errorTableBuffer, &srvDesc, &errorTableView);
+    if (FAILED(hr))
     {
-        vertexAnim.clear();
+        assert(false && "ID3D11Device::CreateShaderResourceView() Failed.");
+        return hr;
     }
-    return retval;
+    return hr;
+}
+
+bool HorseObject::ConvertSequence()
+{
+    return ConvertObjSequence(SequencePath, ReferencePath, ObjPathFormat);
 }
 
 bool HorseObject::OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const UINT width, const UINT height)
@@ -314,27 +342,44 @@ bool HorseObject::OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContex
     XMMATRIX projMatrix = XMMatrixPerspectiveFovLH(XM_PIDIV4, aspectRatio, 0.001f, 1000.0f);
     XMStoreFloat4x4A(&perFrameData.proj, XMMatrixTranspose(projMatrix));
 
-    LoadModel(device, L"./data/horse-gallop-reference.obj", XMFLOAT4A(0.5f, 0.5f, 0.5f, 1.0f));
-    LoadAnim(L"./data/horse-gallop-%02d.obj");
+    LoadModel(device, ReferencePath, XMFLOAT4A(0.5f, 0.5f, 0.5f, 1.0f));
 
     // SSDR
     //
     SSDR::Input ssdrIn;
     ssdrIn.numVertices = numVertices;
-    ssdrIn.numExamples = numFrames;
     ssdrIn.bindModel.resize(numVertices);
     for (unsigned long v = 0; v < numVertices; ++v)
     {
         ssdrIn.bindModel[v] = vertexBufferCPU[v].position;
     }
+
+    // frames are loaded by background workers straight into ssdrIn.sample,
+    // and the solver waits for each frame only when it first touches it
+    // the cache is trusted only if it matches the reference mesh and, when the OBJ files
+    // are present, covers all of them; a stale or truncated cache is rebuilt
+    const unsigned int numObjFrames = FrameLoader::CountObjFiles(ObjPathFormat);
+    MeshSequenceHeader sequenceHeader;
+    bool hasSequence = ReadMeshSequenceHeader(sequenceHeader, SequencePath);
+    if (hasSequence && (sequenceHeader.numVertices != numVertices || sequenceHeader.numFaces != numFaces
+        || sequenceHeader.numFrames == 0 || (numObjFrames != 0 && sequenceHeader.numFrames != numObjFrames)))
+    {
+        OutputDebugStringA("HorseObject: stale mesh sequence cache, reloading the OBJ files.\n");
+        hasSequence = false;
+    }
+    numFrames = hasSequence ? sequenceHeader.numFrames : numObjFrames;
+    ssdrIn.numExamples = numFrames;
     ssdrIn.sample.resize(numFrames * numVertices);
-    for (unsigned long s = 0; s < numFrames; ++s)
+    FrameLoader frameLoader;
+    if (hasSequence)
     {
-        for (unsigned long v = 0; v < numVertices; ++v)
-        {
-            ssdrIn.sample[s * numVertices + v] = vertexAnim[s * numVertices + v];
-        }
+        frameLoader.StartSequence(ssdrIn.sample.data(), sequenceHeader, SequencePath);
+    }
+    else
+    {
+        frameLoader.StartObjFiles(ssdrIn.sample.data(), numFrames, numVertices, ObjPathFormat);
     }
+    ssdrIn.waitExample = [&frameLoader](int s) { return frameLoader.WaitFrame(s); };
 
     SSDR::Parameter ssdrParam;
     ssdrParam.numIndices = CustomVertex::NumInfluences;
@@ -342,11 +387,27 @@ bool HorseObject::OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContex
     ssdrParam.numMaxIterations = 30;
 
     SSDR::Output ssdrOut;
-    SSDR::Decompose(ssdrOut, ssdrIn, ssdrParam);
+    const double errorSq = SSDR::Decompose(ssdrOut, ssdrIn, ssdrParam);
+    // join the loader threads before touching the sample buffer, also when the solver gave up early
+    const bool loaded = frameLoader.WaitAll();
+    ssdrIn.waitExample = nullptr;
+    if (!loaded || errorSq < 0)
+    {
+        assert(false && "FrameLoader failed.");
+        return false;
+    }
+    if (!hasSequence)
+    {
+        // cache the parsed frames as a packed mesh sequence for the next run
+        if (!SaveMeshSequence(SequencePath, faceIndex, ssdrIn.bindModel, ssdrIn.sample, numVertices))
+        {
+            OutputDebugStringA("HorseObject: SaveMeshSequence() failed, the OBJ files will be parsed again next run.\n");
+        }
+    }
 
     for (unsigned long v = 0; v < numVertices; ++v)
     {
-        vertexBufferCPU[v].position = ssdrIn.bindModel[v];
+        XMStoreFloat3A(&vertexBufferCPU[v].position, ssdrIn.LoadBindModel(v));
         for (int i = 0; i < CustomVertex::NumInfluences; ++i)
         {
             vertexBufferCPU[v].indices[i] = ssdrOut.index[v * ssdrParam.numIndices + i];
@@ -355,6 +416,24 @@ bool HorseObject::OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContex
     }
     deviceContext->UpdateSubresource(vertexBuffer, 0, nullptr, vertexBufferCPU, 0, 0);
 
+#ifdef ENABLE_SKINNING_BENCHMARK
+    // compact weights / indices, decoded again below to measure the added error
+    SSDR::CompressedSkin compressedSkin;
+    SSDR::SkinCodecError skinCodecError;
+    SSDR::EncodeSkin(compressedSkin, &skinCodecError, ssdrOut, ssdrParam, 8);
+#endif //ENABLE_SKINNING_BENCHMARK
+
+    vertexAnim.swap(ssdrIn.sample);
+    // skinning reads aligned bind positions
+    bindModel.resize(numVertices);
+    for (unsigned long v = 0; v < numVertices; ++v)
+    {
+        XMStoreFloat3A(&bindModel[v], ssdrIn.LoadBindModel(v));
+    }
+    std::vector<XMFLOAT3>().swap(ssdrIn.bindModel);
+    skinWeight.swap(ssdrOut.weight);
+    skinIndex.swap(ssdrOut.index);
+
     numBones = ssdrOut.numBones;
     boneAnim.resize(ssdrIn.numExamples * ssdrOut.numBones);
     for (int s = 0; s < ssdrIn.numExamples; ++s)
@@ -365,7 +444,70 @@ bool HorseObject::OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContex
         }
     }
 
-    fprintf(stderr, "%d\n", numBones);
+    // playback decodes each frame's palette from the compressed track
+    boneTrack.Compress(boneAnim.data(), numBones, numFrames);
+    bonePose.resize(numBones);
+#ifdef ENABLE_SKINNING_BENCHMARK
+    // size / error report of the compressed track and of the keyframe reduction, only in benchmark builds
+    float modelRadius = 0;
+    for (unsigned long v = 0; v < numVertices; ++v)
+    {
+        modelRadius = std::max(modelRadius, XMVectorGetX(XMVector3Length(XMLoadFloat3A(&bindModel[v]))));
+    }
+    fprintf(stderr, "bone track: %u -> %u bytes, rotation error %f rad, translation error %f (step %f), vertex error < %f\n",
+        static_cast<unsigned int>(boneAnim.size() * sizeof(RigidTransform)), static_cast<unsigned int>(boneTrack.SizeInBytes()),
+        boneTrack.Error().rotation, boneTrack.Error().translation, boneTrack.Error().translationStep,
+        boneTrack.Error().Displacement(modelRadius));
+
+    // sparse keys within a vertex-space tolerance, resampled to check the error
+    KeyframeAnimation keyframeAnim;
+    keyframeAnim.Reduce(boneAnim.data(), numBones, numFrames, bindModel.data(), skinWeight.data(), skinIndex.data(),
+        CustomVertex::NumInfluences, numVertices, KeyframeTolerance);
+    std::vector<RigidTransform> resampledAnim(boneAnim.size());
+    KeyframeAnimation::Cursor keyframeCursor;
+    for (unsigned long f = 0; f < numFrames; ++f)
+    {
+        keyframeAnim.Sample(&resampledAnim[f * numBones], static_cast<float>(f), keyframeCursor);
+    }
+    SkinningBenchmarkResult keyframeResult;
+    BenchmarkSkinning(keyframeResult, SkinningModeLinear, bindModel.data(), skinWeight.data(), skinIndex.data(),
+        CustomVertex::NumInfluences, numVertices, resampledAnim.data(), numBones, vertexAnim.data(), numFrames);
+    fprintf(stderr, "keyframes: %d of %u keys (%u bytes), rms %f, max %f\n",
+        keyframeAnim.NumKeys(), static_cast<unsigned int>(boneAnim.size()), static_cast<unsigned int>(keyframeAnim.SizeInBytes()),
+        keyframeResult.rmsError, keyframeResult.maxError);
+#endif //ENABLE_SKINNING_BENCHMARK
+
+    hr = CreateErrorTable(device);
+    if (FAILED(hr))
+    {
+        assert(false && "HorseObject::CreateErrorTable() Failed.");
+        return false;
+    }
+
+#ifdef ENABLE_SKINNING_BENCHMARK
+    // cost and error of linear vs. dual quaternion skinning on the decomposed rig
+    SkinningBenchmarkResult linearResult, dualQuaternionResult;
+    BenchmarkSkinning(linearResult, SkinningModeLinear, bindModel.data(), skinWeight.data(), skinIndex.data(),
+        CustomVertex::NumInfluences, numVertices, boneAnim.data(), numBones, vertexAnim.data(), numFrames);
+    BenchmarkSkinning(dualQuaternionResult, SkinningModeDualQuaternion, bindModel.data(), skinWeight.data(), skinIndex.data(),
+        CustomVertex::NumInfluences, numVertices, boneAnim.data(), numBones, vertexAnim.data(), numFrames);
+    fprintf(stderr, "LBS: %.3f ms/frame, rms %f, max %f\n",
+        1000.0 * linearResult.seconds / numFrames, linearResult.rmsError, linearResult.maxError);
+    fprintf(stderr, "DQS: %.3f ms/frame, rms %f, max %f\n",
+        1000.0 * dualQuaternionResult.seconds / numFrames, dualQuaternionResult.rmsError, dualQuaternionResult.maxError);
+
+    // skinning error with the 8-bit weights
+    std::vector<float> decodedWeight;
+    std::vector<int> decodedIndex;
+    SSDR::DecodeSkin(decodedWeight, decodedIndex, compressedSkin);
+    SkinningBenchmarkResult compressedSkinResult;
+    BenchmarkSkinning(compressedSkinResult, SkinningModeLinear, bindModel.data(), decodedWeight.data(), decodedIndex.data(),
+        CustomVertex::NumInfluences, numVertices, boneAnim.data(), numBones, vertexAnim.data(), numFrames);
+    fprintf(stderr, "skin weights: %u -> %u bytes, weight error max %f rms %f, rms %f (was %f)\n",
+        static_cast<unsigned int>(skinWeight.size() * sizeof(float) + skinIndex.size() * sizeof(int)),
+        static_cast<unsigned int>(compressedSkin.SizeInBytes()), skinCodecError.maxWeightError, skinCodecError.rmsWeightError,
+        compressedSkinResult.rmsError, linearResult.rmsError);
+#endif //ENABLE_SKINNING_BENCHMARK
 
     return Object::OnInit(device, deviceContext, width, height);
 }
@@ -377,24 +519,6 @@ void HorseObject::OnResize(ID3D11Device* device, ID3D11DeviceContext* deviceCont
     XMStoreFloat4x4A(&perFrameData.proj, XMMatrixTranspose(projMatrix));
 }
 
-void HorseObject::ColorVerticesByError(int frame, float upperBound)
-{
-    for (int v = 0; v < numVertices; ++v)
-    {
-        XMVECTOR pos = XMVectorZero();
-        for (long i = 0; i < CustomVertex::NumInfluences; ++i)
-        {
-            const RigidTransform& rt = boneAnim[numBones * frame + vertexBufferCPU[v].indices[i]];
-            XMVECTOR xv = XMLoadFloat3A(&vertexBufferCPU[v].position);
-            pos += vertexBufferCPU[v].weight[i] * rt.TransformCoord(xv);
-        }
-        XMVECTOR err = XMVector3Length(pos - XMLoadFloat3A(&vertexAnim[numVertices * frame + v]));
-        float l = XMVectorGetX(err) / upperBound;
-        if (l > 1.0f) l = 1.0f;
-        vertexBufferCPU[v].color = XMFLOAT4A(1.0f, 1.0f - l, 1.0f - l, vertexBufferCPU[v].color.w);
-    }
-}
-
 void HorseObject::OnUpdate(ID3D11Device* device, ID3D11DeviceContext* deviceContext, float elapsed)
 {
     frame = (frame + 1) % numFrames;
@@ -412,16 +536,15 @@ void HorseObject::OnUpdate(ID3D11Device* device, ID3D11DeviceContext* deviceCont
     deviceContext->UpdateSubresource(constantBufferPerFrame, 0, nullptr, &perFrameData, 0, 0);
 
     ConstantBufferSkinningMatrix cbs;
+    boneTrack.DecodeFrame(bonePose.data(), frame);
     for (int i = 0; i < numBones; ++i)
     {
-        XMFLOAT4X4A m = boneAnim[frame * numBones + i].ToMatrix4x4();
+        XMFLOAT4X4A m = bonePose[i].ToMatrix4x4();
         XMStoreFloat4x4A(cbs.pallet + i, XMMatrixTranspose(XMLoadFloat4x4A(&m)));
     }
     XMStoreFloat4x4A(cbs.pallet + numBones, XMMatrixIdentity());
     deviceContext->UpdateSubresource(constantBufferSkinningBone, 0, nullptr, &cbs, 0, 0);
 
-    ColorVerticesByError(frame, 0.05f);
-
     ConstantBufferPerObj cbo;
     XMMATRIX invModelTransform = XMMatrixIdentity();
     XMStoreFloat4x4(&cbo.world, XMMatrixTranspose(invModelTransform));
@@ -429,11 +552,12 @@ void HorseObject::OnUpdate(ID3D11Device* device, ID3D11DeviceContext* deviceCont
     XMStoreFloat3A(&cbo.localLightPos, XMVector3TransformCoord(XMVectorSetW(XMLoadFloat3A(&lightPosition), 1.0f), invModelTransform));
     cbo.ambientColor = XMFLOAT4A(0.4f, 0.4f, 0.4f, 1.0f);
     cbo.specExpon = 1.0f;
+    cbo.errorOffset = frame * numVertices;
     deviceContext->UpdateSubresource(constantBufferPerObj, 0, nullptr, &cbo, 0, 0);
 
     for (unsigned long v = 0; v < numVertices; ++v)
     {
-        srcVertexBufferCPU[v].position = vertexAnim[frame * numVertices + v];
+        XMStoreFloat3A(&srcVertexBufferCPU[v].position, XMLoadFloat3(&vertexAnim[frame * numVertices + v]));
         srcVertexBufferCPU[v].indices[0] = numBones;
         srcVertexBufferCPU[v].weight[0] = 1.0;
     }
@@ -471,7 +595,8 @@ void HorseObject::OnRender(ID3D11Device* device, ID3D11DeviceContext* deviceCont
         deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
         deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-        deviceContext->UpdateSubresource(vertexBuffer, 0, nullptr, vertexBufferCPU, 0, 0);
+        // per-frame error colors are looked up from the precomputed table
+        deviceContext->VSSetShaderResources(0, 1, &errorTableView);
         deviceContext->DrawIndexed(numFaces * 3, 0, 0);
 
         //deviceContext->UpdateSubresource(vertexBuffer, 0, nullptr, srcVertexBufferCPU, 0, 0);
@@ -483,6 +608,16 @@ void HorseObject::OnRender(ID3D11Device* device, ID3D11DeviceContext* deviceCont
 
 void HorseObject::OnDestroy()
 {
+    if (errorTableView != nullptr)
+    {
+        errorTableView->Release();
+        errorTableView = nullptr;
+    }
+    if (errorTableBuffer != nullptr)
+    {
+        errorTableBuffer->Release();
+        errorTableBuffer = nullptr;
+    }
     if (vertexBufferCPU != nullptr)
     {
         delete[] vertexBufferCPU;
@@ -4,6 +4,7 @@
 
 #include "Object.h"
 #include "RigidTransform.h"
+#include "BoneTrack.h"
 
 class HorseObject : public Object
 {
@@ -30,6 +31,7 @@ protected:
         DirectX::XMFLOAT3A localLightPos;
         DirectX::XMFLOAT4A ambientColor;
         float specExpon;
+        unsigned int errorOffset;
     };
     struct CustomVertex
     {
@@ -51,6 +53,8 @@ public:
         return r;
     }
     virtual ~HorseObject();
+    // packs the OBJ sequence into the cache read by OnInit()
+    static bool ConvertSequence();
 
 public:
     bool OnInit(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const UINT width, const UINT height) override;
@@ -62,8 +66,7 @@ public:
 protected:
     HRESULT InitShader(ID3D11Device* device);
     HRESULT LoadModel(ID3D11Device* device, const wchar_t* filePath, const DirectX::XMFLOAT4A& color);
-    bool LoadAnim(const wchar_t* filePath);
-    void ColorVerticesByError(int frame, float upperBound);
+    HRESULT CreateErrorTable(ID3D11Device* device);
 
 private:
     ID3D11Buffer* constantBufferPerFrame;
@@ -80,11 +83,19 @@ private:
     ID3D11Buffer* indexBuffer;
     unsigned long numVertices;
     unsigned long numFaces;
+    ID3D11Buffer* errorTableBuffer;
+    ID3D11ShaderResourceView* errorTableView;
+    std::vector<DWORD> faceIndex;
 
     CustomVertex* vertexBufferCPU;
     CustomVertex* srcVertexBufferCPU;
-    std::vector<DirectX::XMFLOAT3A> vertexAnim;
+    std::vector<DirectX::XMFLOAT3> vertexAnim;
     std::vector<RigidTransform> boneAnim;
+    BoneTrack boneTrack;
+    std::vector<RigidTransform> bonePose;
+    std::vector<DirectX::XMFLOAT3A> bindModel;
+    std::vector<float> skinWeight;
+    std::vector<int> skinIndex;
     unsigned long numFrames;
     unsigned long frame;
     int numBones;
@@ -0,0 +1,177 @@
+#include "KeyframeAnimation.h"
+#include <algorithm>
+#ifdef ENABLE_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif //ENABLE_TBB
+
+using namespace DirectX;
+
+static inline void Interpolate(RigidTransform& out, const RigidTransform& a, const RigidTransform& b, float t)
+{
+    XMStoreFloat4A(&out.Rotation(), XMQuaternionSlerp(XMLoadFloat4A(&a.Rotation()), XMLoadFloat4A(&b.Rotation()), t));
+    XMStoreFloat3A(&out.Translation(), XMVectorLerp(XMLoadFloat3A(&a.Translation()), XMLoadFloat3A(&b.Translation()), t));
+}
+
+// true if interpolating bone between frames first and last keeps every
+// influenced point (xyz = bind position, w = error scale) within tolerance
+static bool WithinTolerance(const RigidTransform* boneTrans, int numBones, int bone, int first, int last,
+    const std::vector<XMFLOAT4A>& influence, float tolerance)
+{
+    const RigidTransform& a = boneTrans[first * numBones + bone];
+    const RigidTransform& b = boneTrans[last * numBones + bone];
+    for (int f = first + 1; f < last; ++f)
+    {
+        RigidTransform approx;
+        Interpolate(approx, a, b, static_cast<float>(f - first) / (last - first));
+        const RigidTransform& exact = boneTrans[f * numBones + bone];
+
+        // T'(p) - T(p) = p (R' - R) + (t' - t)
+        const XMMATRIX ra = XMMatrixRotationQuaternion(XMLoadFloat4A(&approx.Rotation()));
+        const XMMATRIX re = XMMatrixRotationQuaternion(XMLoadFloat4A(&exact.Rotation()));
+        XMMATRIX diff;
+        diff.r[0] = XMVectorSubtract(ra.r[0], re.r[0]);
+        diff.r[1] = XMVectorSubtract(ra.r[1], re.r[1]);
+        diff.r[2] = XMVectorSubtract(ra.r[2], re.r[2]);
+        diff.r[3] = XMVectorSubtract(XMLoadFloat3A(&approx.Translation()), XMLoadFloat3A(&exact.Translation()));
+        const XMVECTOR toleranceSq = XMVectorReplicate(tolerance * tolerance);
+        for (auto it = influence.begin(); it != influence.end(); ++it)
+        {
+            const XMVECTOR p = XMLoadFloat4A(&*it);
+            const XMVECTOR e = XMVectorMultiply(XMVector3Transform(p, diff), XMVectorSplatW(p));
+            if (XMVector3Greater(XMVector3LengthSq(e), toleranceSq))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void ReduceBones(int begin, int end, std::vector<std::vector<int>>& boneKeys,
+    const RigidTransform* boneTrans, int numBones, int numFrames,
+    const std::vector<std::vector<XMFLOAT4A>>& influence, float tolerance)
+{
+    for (int b = begin; b < end; ++b)
+    {
+        std::vector<int>& keys = boneKeys[b];
+        keys.clear();
+        keys.push_back(0);
+        // longest segment from the last key that stays within the tolerance:
+        // double its length until it breaks, then bisect, so a segment of
+        // length L costs O(L log L) frame checks instead of O(L^2)
+        for (int first = 0; first < numFrames - 1; first = keys.back())
+        {
+            int good = first + 1;
+            int bad = numFrames;
+            for (int step = 1; good + step < numFrames; step *= 2)
+            {
+                if (!WithinTolerance(boneTrans, numBones, b, first, good + step, influence[b], tolerance))
+                {
+                    bad = good + step;
+                    break;
+                }
+                good += step;
+            }
+            while (bad - good > 1)
+            {
+                const int mid = (good + bad) / 2;
+                if (WithinTolerance(boneTrans, numBones, b, first, mid, influence[b], tolerance))
+                {
+                    good = mid;
+                }
+                else
+                {
+                    bad = mid;
+                }
+            }
+            keys.push_back(good);
+        }
+    }
+}
+
+void KeyframeAnimation::Reduce(const RigidTransform* boneTrans, int numBones_, int numFrames_,
+    const XMFLOAT3A* bindModel, const float* weight, const int* index, int numIndices, int numVertices,
+    float tolerance)
+{
+    numBones = numBones_;
+    numFrames = numFrames_;
+
+    // bind positions seen by each bone, scaled by w_vb * n_v
+    std::vector<std::vector<XMFLOAT4A>> influence(numBones);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        int numInfluences = 0;
+        for (int i = 0; i < numIndices; ++i)
+        {
+            numInfluences += (weight[v * numIndices + i] > 0);
+        }
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const float w = weight[v * numIndices + i];
+            if (w > 0)
+            {
+                const XMFLOAT3A& p = bindModel[v];
+                influence[index[v * numIndices + i]].push_back(XMFLOAT4A(p.x, p.y, p.z, w * numInfluences));
+            }
+        }
+    }
+
+    std::vector<std::vector<int>> boneKeys(numBones);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numBones, 1),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ReduceBones(range.begin(), range.end(), boneKeys, boneTrans, numBones, numFrames, influence, tolerance);
+    });
+#else
+    ReduceBones(0, numBones, boneKeys, boneTrans, numBones, numFrames, influence, tolerance);
+#endif //ENABLE_TBB
+
+    keyOffset.resize(numBones + 1);
+    keyFrame.clear();
+    keyTransform.clear();
+    for (int b = 0; b < numBones; ++b)
+    {
+        keyOffset[b] = static_cast<int>(keyFrame.size());
+        for (auto it = boneKeys[b].begin(); it != boneKeys[b].end(); ++it)
+        {
+            keyFrame.push_back(*it);
+            keyTransform.push_back(boneTrans[*it * numBones + b]);
+        }
+    }
+    keyOffset[numBones] = static_cast<int>(keyFrame.size());
+}
+
+void KeyframeAnimation::Sample(RigidTransform* boneTrans, float frame, Cursor& cursor) const
+{
+    frame = std::min(std::max(frame, 0.0f), static_cast<float>(numFrames - 1));
+    if (cursor.key.size() != static_cast<size_t>(numBones))
+    {
+        cursor.key.assign(keyOffset.begin(), keyOffset.end() - 1);
+    }
+    for (int b = 0; b < numBones; ++b)
+    {
+        const int begin = keyOffset[b];
+        const int end = keyOffset[b + 1];
+        // playback mostly moves forward by less than a segment, so resume from the last key
+        int& k = cursor.key[b];
+        if (k < begin || k >= end || keyFrame[k] > frame)
+        {
+            k = begin;
+        }
+        while (k + 1 < end && keyFrame[k + 1] <= frame)
+        {
+            ++k;
+        }
+        if (k + 1 == end)
+        {
+            boneTrans[b] = keyTransform[k];
+        }
+        else
+        {
+            const float t = (frame - keyFrame[k]) / (keyFrame[k + 1] - keyFrame[k]);
+            Interpolate(boneTrans[b], keyTransform[k], keyTransform[k + 1], t);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef KEYFRAME_ANIMATION_H
+#define KEYFRAME_ANIMATION_H
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "RigidTransform.h"
+
+// Sparse per-bone keyframes fitted to dense bone motion (e.g. SSDR::Output::boneTrans).
+//
+// Each bone keeps a subset of its input frames; between two keys the rotation
+// is slerped and the translation lerped. Keys are chosen greedily so that the
+// interpolated transform moves no skinned vertex by more than the tolerance:
+// for every vertex v bound to bone b, w_vb * n_v * |T'_b(p_v) - T_b(p_v)| <= tolerance,
+// where n_v is the number of non-zero influences of v. Summing over the
+// influences, the linear blend skinning error of every vertex stays within
+// the tolerance.
+class KeyframeAnimation
+{
+public:
+    // per-bone key position of sequential playback
+    struct Cursor
+    {
+        std::vector<int> key;
+    };
+
+public:
+    KeyframeAnimation()
+        : numBones(0), numFrames(0)
+    {
+    }
+
+public:
+    // boneTrans is numFrames x numBones; weight/index use the SSDR::Output layout
+    void Reduce(const RigidTransform* boneTrans, int numBones, int numFrames,
+        const DirectX::XMFLOAT3A* bindModel, const float* weight, const int* index, int numIndices, int numVertices,
+        float tolerance);
+    // pose of every bone at a (fractional) frame into boneTrans[0 .. numBones)
+    void Sample(RigidTransform* boneTrans, float frame, Cursor& cursor) const;
+
+    int NumBones() const
+    {
+        return numBones;
+    }
+    int NumFrames() const
+    {
+        return numFrames;
+    }
+    int NumKeys() const
+    {
+        return static_cast<int>(keyFrame.size());
+    }
+    int NumKeys(int bone) const
+    {
+        return keyOffset[bone + 1] - keyOffset[bone];
+    }
+    size_t SizeInBytes() const
+    {
+        return keyFrame.size() * (sizeof(int) + sizeof(RigidTransform)) + keyOffset.size() * sizeof(int);
+    }
+
+private:
+    // keys of bone b are [keyOffset[b], keyOffset[b + 1])
+    std::vector<int> keyOffset;
+    std::vector<int> keyFrame;
+    std::vector<RigidTransform> keyTransform;
+    int numBones;
+    int numFrames;
+};
+
+#endif //KEYFRAME_ANIMATION_H
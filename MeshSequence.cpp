@@ -0,0 +1,185 @@
+#include "MeshSequence.h"
+#include <cstdio>
+#include "util.h"
+#include "FrameLoader.h"
+
+using namespace DirectX;
+
+static unsigned long long AlignBlock(unsigned long long offset)
+{
+    const unsigned long long a = MeshSequenceHeader::BlockAlignment;
+    return (offset + a - 1) / a * a;
+}
+
+static bool WritePadding(FILE* fout, unsigned long long offset)
+{
+    static const char zero[MeshSequenceHeader::BlockAlignment] = { 0 };
+    const size_t size = static_cast<size_t>(AlignBlock(offset) - offset);
+    return size == 0 || std::fwrite(zero, 1, size, fout) == size;
+}
+
+static void PackPositions(std::vector<XMFLOAT3>& dst, const std::vector<XMFLOAT3A>& src)
+{
+    dst.assign(src.begin(), src.end());
+}
+
+static bool IsValidHeader(const MeshSequenceHeader& header)
+{
+    return header.signature == MeshSequenceHeader::Signature
+        && header.version == MeshSequenceHeader::CurrentVersion
+        && header.positionStride == sizeof(XMFLOAT3);
+}
+
+static void LayoutHeader(MeshSequenceHeader& header, bool hasBindPose)
+{
+    header.indexOffset = AlignBlock(sizeof(MeshSequenceHeader));
+    unsigned long long offset = AlignBlock(header.indexOffset + sizeof(DWORD) * 3ULL * header.numFaces);
+    header.bindPoseOffset = 0;
+    if (hasBindPose)
+    {
+        header.bindPoseOffset = offset;
+        offset = AlignBlock(offset + header.FrameSize());
+    }
+    header.frameOffset = offset;
+}
+
+// writes everything in front of the first frame; the caller appends the frames
+static bool WriteLeadingBlocks(FILE* fout, const MeshSequenceHeader& header, const DWORD* index, const XMFLOAT3* bindModel)
+{
+    const unsigned long long indexSize = sizeof(DWORD) * 3ULL * header.numFaces;
+    bool retval = std::fwrite(&header, sizeof(MeshSequenceHeader), 1, fout) == 1
+        && WritePadding(fout, sizeof(MeshSequenceHeader))
+        && std::fwrite(index, sizeof(DWORD), header.numFaces * 3, fout) == header.numFaces * 3
+        && WritePadding(fout, header.indexOffset + indexSize);
+    if (retval && header.HasBindPose())
+    {
+        retval = std::fwrite(bindModel, header.positionStride, header.numVertices, fout) == header.numVertices
+            && WritePadding(fout, header.bindPoseOffset + header.FrameSize());
+    }
+    return retval;
+}
+
+bool ReadMeshSequenceHeader(MeshSequenceHeader& header, const std::wstring& filePath)
+{
+    FILE* fin = nullptr;
+    _wfopen_s(&fin, filePath.data(), L"rb");
+    if (fin == nullptr)
+    {
+        return false;
+    }
+    const bool retval = std::fread(&header, sizeof(MeshSequenceHeader), 1, fin) == 1 && IsValidHeader(header);
+    fclose(fin);
+    return retval;
+}
+
+bool ReadMeshSequenceFrames(XMFLOAT3* frames, const MeshSequenceHeader& header, const std::wstring& filePath, unsigned int firstFrame, unsigned int numFrames)
+{
+    if (!IsValidHeader(header) || firstFrame + numFrames > header.numFrames)
+    {
+        return false;
+    }
+    // each call opens its own handle so that frame ranges can be read concurrently
+    FILE* fin = nullptr;
+    _wfopen_s(&fin, filePath.data(), L"rb");
+    if (fin == nullptr)
+    {
+        return false;
+    }
+    const size_t count = static_cast<size_t>(header.numVertices) * numFrames;
+    bool retval = _fseeki64(fin, header.frameOffset + header.FrameSize() * firstFrame, SEEK_SET) == 0
+        && std::fread(frames, header.positionStride, count, fin) == count;
+    fclose(fin);
+    return retval;
+}
+
+bool SaveMeshSequence(const std::wstring& filePath, const std::vector<DWORD>& index, const std::vector<XMFLOAT3>& bindModel, const std::vector<XMFLOAT3>& frames, unsigned int numVertices)
+{
+    if (numVertices == 0 || frames.size() % numVertices != 0 || (!bindModel.empty() && bindModel.size() != numVertices))
+    {
+        return false;
+    }
+
+    MeshSequenceHeader header;
+    header.numVertices = numVertices;
+    header.numFaces = static_cast<unsigned int>(index.size() / 3);
+    header.numFrames = static_cast<unsigned int>(frames.size() / numVertices);
+    LayoutHeader(header, !bindModel.empty());
+
+    FILE* fout = nullptr;
+    _wfopen_s(&fout, filePath.data(), L"wb");
+    if (fout == nullptr)
+    {
+        return false;
+    }
+    const bool retval = WriteLeadingBlocks(fout, header, index.data(), bindModel.data())
+        && std::fwrite(frames.data(), header.positionStride, frames.size(), fout) == frames.size();
+    fclose(fout);
+    if (!retval)
+    {
+        _wremove(filePath.data());
+    }
+    return retval;
+}
+
+bool ConvertObjSequence(const std::wstring& filePath, const std::wstring& referencePath, const std::wstring& framePathFormat, float scale)
+{
+    const unsigned int numFrames = FrameLoader::CountObjFiles(framePathFormat);
+    if (numFrames == 0)
+    {
+        return false;
+    }
+
+    // topology (and the bind pose, if given) are taken from the reference mesh
+    wchar_t pathBuf[1024];
+    std::vector<XMFLOAT3A> bindModel, position;
+    std::vector<XMFLOAT3> packedBindModel, packed;
+    std::vector<DWORD> index;
+    if (!referencePath.empty())
+    {
+        if (!LoadObjFile(bindModel, index, referencePath, scale))
+        {
+            return false;
+        }
+        PackPositions(packedBindModel, bindModel);
+    }
+    else
+    {
+        swprintf_s(pathBuf, framePathFormat.data(), 1);
+        if (!LoadObjFile(position, index, pathBuf, scale))
+        {
+            return false;
+        }
+    }
+
+    MeshSequenceHeader header;
+    header.numVertices = static_cast<unsigned int>(bindModel.empty() ? position.size() : bindModel.size());
+    header.numFaces = static_cast<unsigned int>(index.size() / 3);
+    header.numFrames = numFrames;
+    LayoutHeader(header, !bindModel.empty());
+
+    FILE* fout = nullptr;
+    _wfopen_s(&fout, filePath.data(), L"wb");
+    if (fout == nullptr)
+    {
+        return false;
+    }
+    bool retval = WriteLeadingBlocks(fout, header, index.data(), packedBindModel.data());
+    // frames are streamed one at a time so the whole sequence never has to be resident
+    std::vector<DWORD> frameIndex;
+    for (unsigned int f = 0; retval && f < numFrames; ++f)
+    {
+        swprintf_s(pathBuf, framePathFormat.data(), f + 1);
+        retval = LoadObjFile(position, frameIndex, pathBuf, scale) && position.size() == header.numVertices;
+        if (retval)
+        {
+            PackPositions(packed, position);
+            retval = std::fwrite(packed.data(), header.positionStride, header.numVertices, fout) == header.numVertices;
+        }
+    }
+    fclose(fout);
+    if (!retval)
+    {
+        _wremove(filePath.data());
+    }
+    return retval;
+}
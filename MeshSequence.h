@@ -0,0 +1,54 @@
+#ifndef MESH_SEQUENCE_H
+#define MESH_SEQUENCE_H
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// Packed binary mesh sequence (*.mseq)
+//
+//   header | index (numFaces x 3) | bind pose (numVertices) | frames (numFrames x numVertices)
+//
+// Every block starts on a 16-byte boundary and positions are tightly packed
+// float3 (the same layout as SSDR::Input), so frames can be read straight into
+// Input::sample. Version 1 files stored 16-byte padded positions and are rejected.
+struct MeshSequenceHeader
+{
+    static const unsigned int Signature = 0x5153454d; // "MESQ"
+    static const unsigned int CurrentVersion = 2;
+    static const unsigned int BlockAlignment = 16;
+
+    unsigned int signature;
+    unsigned int version;
+    unsigned int numVertices;
+    unsigned int numFaces;
+    unsigned int numFrames;
+    unsigned int positionStride;
+    unsigned long long indexOffset;
+    unsigned long long bindPoseOffset;
+    unsigned long long frameOffset;
+
+    MeshSequenceHeader()
+        : signature(Signature), version(CurrentVersion),
+        numVertices(0), numFaces(0), numFrames(0),
+        positionStride(sizeof(DirectX::XMFLOAT3)),
+        indexOffset(0), bindPoseOffset(0), frameOffset(0)
+    {
+    }
+    bool HasBindPose() const
+    {
+        return bindPoseOffset != 0;
+    }
+    unsigned long long FrameSize() const
+    {
+        return static_cast<unsigned long long>(numVertices) * positionStride;
+    }
+};
+
+extern bool ReadMeshSequenceHeader(MeshSequenceHeader& header, const std::wstring& filePath);
+extern bool ReadMeshSequenceFrames(DirectX::XMFLOAT3* frames, const MeshSequenceHeader& header, const std::wstring& filePath, unsigned int firstFrame, unsigned int numFrames);
+extern bool SaveMeshSequence(const std::wstring& filePath, const std::vector<DWORD>& index, const std::vector<DirectX::XMFLOAT3>& bindModel, const std::vector<DirectX::XMFLOAT3>& frames, unsigned int numVertices);
+extern bool ConvertObjSequence(const std::wstring& filePath, const std::wstring& referencePath, const std::wstring& framePathFormat, float scale = 1.0f);
+
+#endif //MESH_SEQUENCE_H
@@ -2,10 +2,10 @@
 
 using namespace Eigen;
 
-double SolveQP(const MatrixXd& gm, const VectorXd& gv,
-    const MatrixXd& cem, const VectorXd& cev,
-    const MatrixXd& cim, const VectorXd& civ,
-    VectorXd& xv)
+double SolveQP(const Ref<const MatrixXd>& gm, const Ref<const VectorXd>& gv,
+    const Ref<const MatrixXd>& cem, const Ref<const VectorXd>& cev,
+    const Ref<const MatrixXd>& cim, const Ref<const VectorXd>& civ,
+    Ref<VectorXd> xv)
 {
     QuadProgPP::Matrix<double> G(gm.rows(), gm.cols());
     for (int i = 0; i < gm.rows(); ++i)
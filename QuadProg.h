@@ -8,10 +8,11 @@
 // min (0.5 * xv^T * gm * xv + gv^T * x)
 //  s.t. cem * xv + cev = 0
 //       cim * xv + civ >= 0
-double SolveQP(const Eigen::MatrixXd& gm, const Eigen::VectorXd& gv,
-    const Eigen::MatrixXd& cem, const Eigen::VectorXd& cev,
-    const Eigen::MatrixXd& cim, const Eigen::VectorXd& civ,
-    Eigen::VectorXd& xv);
+// (Ref parameters also accept fixed-size and fixed-capacity Eigen objects without a copy)
+double SolveQP(const Eigen::Ref<const Eigen::MatrixXd>& gm, const Eigen::Ref<const Eigen::VectorXd>& gv,
+    const Eigen::Ref<const Eigen::MatrixXd>& cem, const Eigen::Ref<const Eigen::VectorXd>& cev,
+    const Eigen::Ref<const Eigen::MatrixXd>& cim, const Eigen::Ref<const Eigen::VectorXd>& civ,
+    Eigen::Ref<Eigen::VectorXd> xv);
 double TestSolveQP();
 
 #endif //QUADPROG_H
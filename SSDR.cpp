@@ -1,9 +1,12 @@
 #include "SSDR.h"
 #include <limits>
 #include <algorithm>
+#include <cmath>
+#include <random>
 #include <Eigen/Core>
 #include <Eigen/Eigen>
 #include "QuadProg.h"
+#include "Skinning.h"
 #ifdef ENABLE_TBB
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
@@ -14,261 +17,266 @@ using namespace Eigen;
 
 namespace SSDR {
 
-double ComputeApproximationErrorSq(const Output& output, const Input& input, const Parameter& param)
+// _v̗Ꭶf[^sł̋ߎc q_sv - _i w_i T_{b_i}(p_v)
+// paletteOffsetFpalette̗Ꭶf[^s̐擪{[̈ʒu
+inline XMVECTOR ComputeResidual(int s, int v, int paletteOffset, const Output& output, const Input& input, int numIndices, const SkinningPalette& palette)
 {
-    std::vector<double> errsq(input.numExamples);
-    double rsqsum = 0;
-    for (int s = 0; s < input.numExamples; ++s)
+    XMVECTOR residual = input.LoadSample(s, v);
+    const XMVECTOR p = input.LoadBindModel(v);
+    for (int i = 0; i < numIndices; ++i)
     {
-        const int numVertices = input.numVertices;
-        const int numIndices = param.numIndices;
-        const int numBones = output.numBones;
-        const int numExamples = input.numExamples;
-
-        for (int s = 0; s < numExamples; ++s)
+        const float w = output.weight[v * numIndices + i];
+        if (w != 0)
         {
-            for (int v = 0; v < numVertices; ++v)
-            {
-                XMVECTOR residual = XMLoadFloat3A(&input.sample[s * numVertices + v]);
-                const XMVECTOR& p = XMLoadFloat3A(&input.bindModel[v]);
-                for (int i = 0; i < numIndices; ++i)
-                {
-                    const int b = output.index[v * numIndices + i];
-                    const float w = output.weight[v * numIndices + i];
-                    const RigidTransform& rt = output.boneTrans[s * numBones + b];
-                    residual -= w * rt.TransformCoord(p);
-                }
-                rsqsum += XMVectorGetX(XMVector3LengthSq(residual));
-            }
+            residual -= w * palette.TransformCoord(paletteOffset + output.index[v * numIndices + i], p);
         }
     }
-    return rsqsum;
+    return residual;
 }
-#ifdef ENABLE_TBB
-class WeightMapUpdator
+
+// XLjOEFCgXV̐
+struct WeightConstraints
 {
-private:
-    Output* output;
-    const Input* input;
-    const Parameter* param;
-    const MatrixXd* cem;
-    const MatrixXd* cim;
-    const VectorXd* cev;
-    const VectorXd* civ;
-    const MatrixXd* scem;
-    const MatrixXd* scim;
-    const VectorXd* sciv;
-public:
-    WeightMapUpdator(Output* output_, const Input* input_, const Parameter* param_,
-        const MatrixXd* cem_, const MatrixXd* cim_, const VectorXd* cev_, const VectorXd* civ_,
-        const MatrixXd* scem_, const MatrixXd* scim_, const VectorXd* sciv_)
-        : output(output_), input(input_), param(param_),
-        cem(cem_), cim(cim_), cev(cev_), civ(civ_),
-        scem(scem_), scim(scim_), sciv(sciv_)
+    // a : cem * xv + cev = 0
+    MatrixXd cem, scem;
+    VectorXd cev;
+    // 񕉐 : cim * xv + civ >= 0
+    MatrixXd cim, scim;
+    VectorXd civ, sciv;
+
+    WeightConstraints(int numBones, int numIndices)
+        : cem(MatrixXd::Constant(1, numBones, 1.0)), scem(MatrixXd::Constant(1, numIndices, 1.0)),
+        cev(VectorXd::Constant(1, -1.0)),
+        cim(MatrixXd::Identity(numBones, numBones)), scim(MatrixXd::Identity(numIndices, numIndices)),
+        civ(VectorXd::Zero(numBones)), sciv(VectorXd::Zero(numIndices))
     {
     }
-    void operator ()(const tbb::blocked_range<int>& range) const
-    {
-        const int numVertices = input->numVertices;
-        const int numExamples = input->numExamples;
-        const int numIndices = param->numIndices;
-        const int numBones = output->numBones;
+};
 
-        MatrixXd gm = MatrixXd::Zero(numBones, numBones), sgm = MatrixXd::Zero(numIndices, numIndices);
-        VectorXd gv = VectorXd::Zero(numBones), sgv = VectorXd::Zero(numIndices);
+// {[΂̃[gF_p̃Os͗Ꭶf[^ɂ炸
+// G_bc = _s (R_bs p + t_bs)E(R_cs p + t_cs) = p^T M_bc p + u_bcEp + k_bc
+// M_bc = _s R_bs^T R_csCu_bc = _s (R_bs^T t_cs + R_cs^T t_bs)Ck_bc = _s t_bsEt_cs
+// ԕ̊ U ꍇ͋OՂˉec |U^T (A w - q)|^2 ŏ̂ŁC
+// _s ˉe]sƕsړɂĂ _k ɒu
+// ˉeOs̊K͍X 3 x Ȃ̂ŁC{[𒴂ꍇ͎ˉeȂ
+struct BonePairMoments
+{
+    //! {[(b <= c) M_bci9vfCsDjCu_bci3vfjCk_bc
+    std::vector<double> pair;
+    //! {[̉]sƕsړiᎦf[^ x {[j
+    std::vector<Matrix3d> rotation;
+    std::vector<Vector3d> translation;
+    //! ԕ̊Ŏˉe]sƕsړi x {[CˉeȂꍇ͋j
+    //! _s U_sk R_bsC_s U_sk t_bs
+    std::vector<Matrix3d> projectedRotation;
+    std::vector<Vector3d> projectedTranslation;
+    //! ˉeɎg̎i0ȂˉeȂj
+    int rank;
+    int numBones;
 
-        VectorXd weight = VectorXd::Zero(numBones), w0, sweight = VectorXd::Zero(numIndices);
-        MatrixXd basis = MatrixXd::Zero(numBones, numExamples * 3), sbasis = MatrixXd::Zero(numIndices, numExamples * 3);
-        VectorXd targetVertex = VectorXd::Zero(numExamples * 3);
+    static const int PairSize = 13;
+};
 
-        for (int v = range.begin(); v != range.end(); ++v)
+// rotationCtranslationFnumSamples x {[
+void ComputeBonePairMomentsRange(int begin, int end, BonePairMoments& moments, const std::vector<Matrix3d>& rotation, const std::vector<Vector3d>& translation, int numSamples)
+{
+    const int numBones = moments.numBones;
+    for (int b = begin; b < end; ++b)
+    {
+        for (int c = b; c < numBones; ++c)
         {
-            const XMVECTOR restVertex = XMLoadFloat3A(&input->bindModel[v]);
-            for (int s = 0; s < numExamples; ++s)
-            {
-                for (int b = 0; b < numBones; ++b)
-                {
-                    const RigidTransform& rt = output->boneTrans[s * numBones + b];
-                    XMVECTOR tv = rt.TransformCoord(restVertex);
-                    basis(b, s * 3 + 0) = XMVectorGetX(tv);
-                    basis(b, s * 3 + 1) = XMVectorGetY(tv);
-                    basis(b, s * 3 + 2) = XMVectorGetZ(tv);
-                }
-            }
-            for (int s = 0; s < numExamples; ++s)
-            {
-                targetVertex[s * 3 + 0] = input->sample[s * numVertices + v].x;
-                targetVertex[s * 3 + 1] = input->sample[s * numVertices + v].y;
-                targetVertex[s * 3 + 2] = input->sample[s * numVertices + v].z;
-            }
-            // G = A * A^T
-            gm = basis * basis.transpose();
-            // g = A^T * b
-            gv = -basis * targetVertex;
-
-            double qperr = SolveQP(gm, gv, *cem, *cev, *cim, *civ, weight);
-            assert(qperr != std::numeric_limits<double>::infinity());
-
-            float weightSum = 0;
-            for (int i = 0; i < numIndices; ++i)
-            {
-                double maxw = -std::numeric_limits<double>::max();
-                int bestbone = -1;
-                for (int b = 0; b < numBones; ++b)
-                {
-                    if (weight[b] > maxw)
-                    {
-                        maxw = weight[b];
-                        bestbone = b;
-                    }
-                }
-                if (maxw <= 0)
-                {
-                    break;
-                }
-
-                output->index[v * numIndices + i] = bestbone;
-                output->weight[v * numIndices + i] = static_cast<float>(maxw);
-                weightSum += static_cast<float>(maxw);
-                weight[bestbone] = 0;
-            }
-
-            if (weightSum < 1.0f)
+            Matrix3d m = Matrix3d::Zero();
+            Vector3d u = Vector3d::Zero();
+            double k = 0;
+            for (int s = 0; s < numSamples; ++s)
             {
-                for (int j = 0; j < numExamples * 3; ++j)
-                {
-                    for (int i = 0; i < numIndices; ++i)
-                    {
-                        sbasis(i, j) = basis(output->index[v * numIndices + i], j);
-                    }
-                }
-                sgm = sbasis * sbasis.transpose();
-                sgv = -sbasis * targetVertex;
-                qperr = SolveQP(sgm, sgv, *scem, *cev, *scim, *sciv, sweight);
-                if (qperr != std::numeric_limits<double>::infinity())
-                {
-                    for (int i = 0; i < numIndices; ++i)
-                    {
-                        output->weight[v * numIndices + i] = static_cast<float>(sweight[i]);
-                    }
-                }
-                else
-                {
-                    for (int i = 0; i < numIndices; ++i)
-                    {
-                        output->weight[v * numIndices + i] /= weightSum;
-                    }
-                }
+                const Matrix3d& rb = rotation[s * numBones + b];
+                const Matrix3d& rc = rotation[s * numBones + c];
+                const Vector3d& tb = translation[s * numBones + b];
+                const Vector3d& tc = translation[s * numBones + c];
+                m.noalias() += rb.transpose() * rc;
+                u.noalias() += rb.transpose() * tc + rc.transpose() * tb;
+                k += tb.dot(tc);
             }
+            double* dst = &moments.pair[(b * numBones + c) * BonePairMoments::PairSize];
+            Map<Matrix<double, 3, 3, RowMajor>> pairM(dst);
+            Map<Vector3d> pairU(dst + 9);
+            pairM = m;
+            pairU = u;
+            dst[12] = k;
         }
     }
-};
-void UpdateWeightMap(Output& output, const Input& input, const Parameter& param)
+}
+
+void ComputeBonePairMoments(BonePairMoments& moments, const Output& output, const Input& input)
 {
+    const int numExamples = input.numExamples;
     const int numBones = output.numBones;
-    const int numIndices = param.numIndices;
-
-    // partition of unity : cem^T xv + cev = 0
-    MatrixXd cem = MatrixXd::Zero(1, numBones);
-    MatrixXd scem = MatrixXd::Zero(1, numIndices);
-    VectorXd cev = VectorXd::Zero(1);
-    // 񕉐 : cim^T xv + civ >= 0
-    MatrixXd cim = MatrixXd::Zero(numBones, numBones);
-    MatrixXd scim = MatrixXd::Zero(numIndices, numIndices);
-    VectorXd civ = VectorXd::Zero(numBones);
-    VectorXd sciv = VectorXd::Zero(numIndices);
-    for (int b = 0; b < numBones; ++b)
+    moments.numBones = numBones;
+    moments.pair.resize(numBones * numBones * BonePairMoments::PairSize);
+    moments.rotation.resize(numExamples * numBones);
+    moments.translation.resize(numExamples * numBones);
+    for (int i = 0; i < numExamples * numBones; ++i)
     {
-        cem(0, b) = -1.0;
-        cim(b, b) = 1.0;
-        civ(b) = 0;
+        const XMFLOAT4A& q = output.boneTrans[i].Rotation();
+        const XMFLOAT3A& t = output.boneTrans[i].Translation();
+        moments.rotation[i] = Quaterniond(q.w, q.x, q.y, q.z).toRotationMatrix();
+        moments.translation[i] = Vector3d(t.x, t.y, t.z);
     }
-    for (int i = 0; i < numIndices; ++i)
+    const int numBasis = input.temporalRank;
+    assert(input.temporalBasis.size() == static_cast<size_t>(numExamples * numBasis));
+    const int rank = (3 * numBasis >= numBones) ? numBasis : 0;
+    moments.rank = rank;
+    moments.projectedRotation.assign(rank * numBones, Matrix3d::Zero());
+    moments.projectedTranslation.assign(rank * numBones, Vector3d::Zero());
+    for (int s = 0; s < numExamples; ++s)
     {
-        scem(0, i) = -1.0;
-        scim(i, i) = 1.0;
-        sciv(i) = 0;
+        for (int k = 0; k < rank; ++k)
+        {
+            const double u = input.temporalBasis[s * numBasis + k];
+            for (int b = 0; b < numBones; ++b)
+            {
+                moments.projectedRotation[k * numBones + b] += u * moments.rotation[s * numBones + b];
+                moments.projectedTranslation[k * numBones + b] += u * moments.translation[s * numBones + b];
+            }
+        }
     }
-    cev(0) = 1.0;
-
-    tbb::parallel_for(tbb::blocked_range<int>(0, input.numVertices),
-        WeightMapUpdator(&output, &input, &param,
-        &cem, &cim, &cev, &civ, &scem,
-        &scim, &sciv));
-}
+    const std::vector<Matrix3d>& rotation = (rank > 0) ? moments.projectedRotation : moments.rotation;
+    const std::vector<Vector3d>& translation = (rank > 0) ? moments.projectedTranslation : moments.translation;
+    const int numSamples = (rank > 0) ? rank : numExamples;
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numBones, 1),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ComputeBonePairMomentsRange(range.begin(), range.end(), moments, rotation, translation, numSamples);
+    });
 #else
-void UpdateWeightMap(Output& output, const Input& input, const Parameter& param)
+    ComputeBonePairMomentsRange(0, numBones, moments, rotation, translation, numSamples);
+#endif //ENABLE_TBB
+}
+
+// _p̃Os̗vf G_bc
+inline double BonePairGram(const BonePairMoments& moments, int b, int c, const Vector3d& p)
 {
-    const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
-    const int numBones = output.numBones;
+    const double* m = &moments.pair[(std::min(b, c) * moments.numBones + std::max(b, c)) * BonePairMoments::PairSize];
+    const Vector3d mp(m[0] * p.x() + m[1] * p.y() + m[2] * p.z(),
+        m[3] * p.x() + m[4] * p.y() + m[5] * p.z(),
+        m[6] * p.x() + m[7] * p.y() + m[8] * p.z());
+    return p.dot(mp) + m[9] * p.x() + m[10] * p.y() + m[11] * p.z() + m[12];
+}
 
-    // a : cem * xv + cev = 0
-    MatrixXd cem = MatrixXd::Zero(1, numBones);
-    MatrixXd scem = MatrixXd::Zero(1, numIndices);
-    VectorXd cev = VectorXd::Zero(1);
-    for (int b = 0; b < numBones; ++b)
-    {
-        cem(0, b) = 1.0;
-    }
-    cev(0) = -1.0;
-    // 񕉐 : cim * xv + civ >= 0
-    MatrixXd cim = MatrixXd::Zero(numBones, numBones);
-    MatrixXd scim = MatrixXd::Zero(numIndices, numIndices);
-    VectorXd civ = VectorXd::Zero(numBones);
-    VectorXd sciv = VectorXd::Zero(numIndices);
-    for (int b = 0; b < numBones; ++b)
+// _vɂ _s (R_bs p + t_bs)Eq_s = pE_s R_bs^T q_s + _s t_bsEq_s
+// ԕ̊ꂪꍇ _k (R~_bk p + t~_bk)Ec_vkic_vk = _s U_sk q_sjɔႷvZʂŋ߂
+inline double BoneSampleDot(const BonePairMoments& moments, int b, int v, const Vector3d& p, const Input& input)
+{
+    const int numBones = moments.numBones;
+    Vector3d rq = Vector3d::Zero();
+    double tq = 0;
+    const int rank = moments.rank;
+    if (rank > 0)
     {
-        cim(b, b) = 1.0;
-        civ(b) = 0;
+        for (int k = 0; k < rank; ++k)
+        {
+            const XMFLOAT3& c = input.sampleCoefficient[v * rank + k];
+            const Vector3d cv(c.x, c.y, c.z);
+            rq.noalias() += moments.projectedRotation[k * numBones + b].transpose() * cv;
+            tq += moments.projectedTranslation[k * numBones + b].dot(cv);
+        }
+        return p.dot(rq) + tq;
     }
-    for (int i = 0; i < numIndices; ++i)
+    for (int s = 0; s < input.numExamples; ++s)
     {
-        scem(0, i) = 1.0;
-        scim(i, i) = 1.0;
-        sciv(i) = 0;
+        XMFLOAT3 q;
+        XMStoreFloat3(&q, input.LoadSample(s, v));
+        const Vector3d qv(q.x, q.y, q.z);
+        rq.noalias() += moments.rotation[s * numBones + b].transpose() * qv;
+        tq += moments.translation[s * numBones + b].dot(qv);
     }
-    
-    MatrixXd gm = MatrixXd::Zero(numBones, numBones);
-    MatrixXd sgm = MatrixXd::Zero(numIndices, numIndices);
-    VectorXd gv = VectorXd::Zero(numBones);
-    VectorXd sgv = VectorXd::Zero(numIndices);
+    return p.dot(rq) + tq;
+}
+
+// _͈[begin, end)̃XLjOEFCgXV
+// MaxBonesF{[̏CNumIndicesFCfNXiDynamicȂs̒lgj
+// ܂Ăs̓X^bNɊmۂCCfNX̃[v͓WJ
+// moments^ꍇ̓Os{[΂̃[g狁߂
+// paletteoutput.boneTrans̍s
+template <int MaxBones, int NumIndices>
+void UpdateWeightMapRange(int begin, int end, Output& output, const Input& input, const Parameter& param, const WeightConstraints& constraints, const BonePairMoments* moments, const SkinningPalette& palette)
+{
+    typedef Matrix<double, Dynamic, Dynamic, 0, MaxBones, MaxBones> GramMatrix;
+    typedef Matrix<double, Dynamic, 1, 0, MaxBones, 1> BoneVector;
+    typedef Matrix<double, Dynamic, Dynamic, 0, MaxBones, Dynamic> BasisMatrix;
+    typedef Matrix<double, NumIndices, NumIndices> SubGramMatrix;
+    typedef Matrix<double, NumIndices, 1> SubVector;
+    typedef Matrix<double, NumIndices, Dynamic> SubBasisMatrix;
+
+    const int numExamples = input.numExamples;
+    const int numIndices = (NumIndices == Dynamic) ? param.numIndices : NumIndices;
+    const int numBones = output.numBones;
+    assert(MaxBones == Dynamic || numBones <= MaxBones);
 
-    VectorXd weight = VectorXd::Zero(numBones);
-    VectorXd sweight = VectorXd::Zero(numIndices);
-    MatrixXd am = MatrixXd::Zero(numBones, numExamples * 3);
-    MatrixXd sam = MatrixXd::Zero(numIndices, numExamples * 3);
+    GramMatrix gm;
+    BoneVector gv, weight;
+    BasisMatrix am;
+    gm.resize(numBones, numBones);
+    gv.resize(numBones);
+    weight.resize(numBones);
+    am.resize(numBones, (moments != nullptr) ? 0 : numExamples * 3);
+    SubGramMatrix sgm;
+    SubVector sgv, sweight;
+    SubBasisMatrix sam;
+    sgm.resize(numIndices, numIndices);
+    sgv.resize(numIndices);
+    sweight.resize(numIndices);
+    sam.resize(numIndices, (moments != nullptr) ? 0 : numExamples * 3);
     VectorXd bv = VectorXd::Zero(numExamples * 3);
+    std::vector<float> tx(numBones), ty(numBones), tz(numBones);
 
-    for (int v = 0; v < numVertices; ++v)
+    for (int v = begin; v < end; ++v)
     {
-        const XMVECTOR restVertex = XMLoadFloat3A(&input.bindModel[v]);
-        for (int s = 0; s < numExamples; ++s)
+        if (moments != nullptr)
         {
+            const Vector3d p(input.bindModel[v].x, input.bindModel[v].y, input.bindModel[v].z);
             for (int b = 0; b < numBones; ++b)
             {
-                const RigidTransform& rt = output.boneTrans[s * numBones + b];
-                XMVECTOR tv = rt.TransformCoord(restVertex);
-                am(b, s * 3 + 0) = XMVectorGetX(tv);
-                am(b, s * 3 + 1) = XMVectorGetY(tv);
-                am(b, s * 3 + 2) = XMVectorGetZ(tv);
+                for (int c = b; c < numBones; ++c)
+                {
+                    gm(b, c) = gm(c, b) = BonePairGram(*moments, b, c, p);
+                }
+                gv[b] = -BoneSampleDot(*moments, b, v, p, input);
             }
         }
-        for (int s = 0; s < numExamples; ++s)
+        else
         {
-            bv[s * 3 + 0] = input.sample[s * numVertices + v].x;
-            bv[s * 3 + 1] = input.sample[s * numVertices + v].y;
-            bv[s * 3 + 2] = input.sample[s * numVertices + v].z;
+            for (int s = 0; s < numExamples; ++s)
+            {
+                palette.TransformCoord(tx.data(), ty.data(), tz.data(), s * numBones, numBones, input.bindModel[v]);
+                for (int b = 0; b < numBones; ++b)
+                {
+                    am(b, s * 3 + 0) = tx[b];
+                    am(b, s * 3 + 1) = ty[b];
+                    am(b, s * 3 + 2) = tz[b];
+                }
+            }
+            for (int s = 0; s < numExamples; ++s)
+            {
+                XMFLOAT3 q;
+                XMStoreFloat3(&q, input.LoadSample(s, v));
+                bv[s * 3 + 0] = q.x;
+                bv[s * 3 + 1] = q.y;
+                bv[s * 3 + 2] = q.z;
+            }
+            // G = A * A^T
+            gm.noalias() = am * am.transpose();
+            // g = A^T * b
+            gv.noalias() = -am * bv;
         }
-        // G = A * A^T
-        gm = am * am.transpose();
-        // g = A^T * b
-        gv = -am * bv;
 
-        double qperr = SolveQP(gm, gv, cem, cev, cim, civ, weight);
+        double qperr = SolveQP(gm, gv, constraints.cem, constraints.cev, constraints.cim, constraints.civ, weight);
         assert(qperr != std::numeric_limits<double>::infinity());
 
+        // EFCg̑傫ɃCfNX֊蓖Ă
+        // EFCg0̃CfNXɂgp̃{[蓖āCœ{[dȂ悤ɂ
         float weightSum = 0;
         for (int i = 0; i < numIndices; ++i)
         {
@@ -282,29 +290,49 @@ void UpdateWeightMap(Output& output, const Input& input, const Parameter& param)
                     bestbone = b;
                 }
             }
-            if (maxw <= 0)
+            if (bestbone < 0)
             {
-                break;
+                // {[CfNX菭Ȃꍇi͉Ȃj
+                output.index[v * numIndices + i] = 0;
+                output.weight[v * numIndices + i] = 0;
+                continue;
             }
 
+            const float w = static_cast<float>(std::max(maxw, 0.0));
             output.index[v * numIndices + i] = bestbone;
-            output.weight[v * numIndices + i] = static_cast<float>(maxw);
-            weightSum += static_cast<float>(maxw);
-            weight[bestbone] = 0;
+            output.weight[v * numIndices + i] = w;
+            weightSum += w;
+            weight[bestbone] = -std::numeric_limits<double>::infinity();
         }
 
-        if (weightSum < 1.0f)
+        // S{[CfNXɎ܂ꍇ͏̉̂܂ܕ̉
+        if (weightSum < 1.0f && numBones > numIndices)
         {
-            for (int j = 0; j < numExamples * 3; ++j)
+            if (moments != nullptr)
             {
+                // ̃Os͑Ŝ̃Os̕s
                 for (int i = 0; i < numIndices; ++i)
                 {
-                    sam(i, j) = am(output.index[v * numIndices + i], j);
+                    for (int k = 0; k < numIndices; ++k)
+                    {
+                        sgm(i, k) = gm(output.index[v * numIndices + i], output.index[v * numIndices + k]);
+                    }
+                    sgv[i] = gv[output.index[v * numIndices + i]];
+                }
+            }
+            else
+            {
+                for (int j = 0; j < numExamples * 3; ++j)
+                {
+                    for (int i = 0; i < numIndices; ++i)
+                    {
+                        sam(i, j) = am(output.index[v * numIndices + i], j);
+                    }
                 }
+                sgm.noalias() = sam * sam.transpose();
+                sgv.noalias() = -sam * bv;
             }
-            sgm = sam * sam.transpose();
-            sgv = -sam * bv;
-            qperr = SolveQP(sgm, sgv, scem, cev, scim, sciv, sweight);
+            qperr = SolveQP(sgm, sgv, constraints.scem, constraints.cev, constraints.scim, constraints.sciv, sweight);
             if (qperr != std::numeric_limits<double>::infinity())
             {
                 for (int i = 0; i < numIndices; ++i)
@@ -322,447 +350,2575 @@ void UpdateWeightMap(Output& output, const Input& input, const Parameter& param)
         }
     }
 }
-#endif
 
-// Xgxxx.13FHorn̓_Qʒu킹ASY
-RigidTransform CalcPointsAlignment(size_t numPoints, std::vector<XMFLOAT3A>::const_iterator ps, std::vector<XMFLOAT3A>::const_iterator pd)
-{
-    RigidTransform transform;
+typedef void (*WeightMapKernel)(int begin, int end, Output& output, const Input& input, const Parameter& param, const WeightConstraints& constraints, const BonePairMoments* moments, const SkinningPalette& palette);
 
-    // ꂼ̓_Q̏dSW̌vZ
-    XMVECTOR cs = XMVectorZero(), cd = XMVectorZero();
-    std::vector<XMFLOAT3A>::const_iterator sit = ps;
-    std::vector<XMFLOAT3A>::const_iterator dit = pd;
-    for (size_t i = 0; i < numPoints; ++i, ++sit, ++dit)
+template <int NumIndices>
+WeightMapKernel SelectWeightMapKernel(int numBones)
+{
+    if (numBones <= 16)
     {
-        cs += XMLoadFloat3A(&(*sit));
-        cd += XMLoadFloat3A(&(*dit));
+        return UpdateWeightMapRange<16, NumIndices>;
     }
-    cs /= numPoints;
-    cd /= numPoints;
-
-    // ]̐肪łȂ or ]𐄒肵Ȃꍇ͕sړ̂ݖ߂
-    if (numPoints < 3)
+    if (numBones <= 32)
     {
-        XMStoreFloat3A(&transform.Translation(), cd - cs);
-        return transform;
+        return UpdateWeightMapRange<32, NumIndices>;
     }
-
-    // [gšvZ
-    Matrix<double, 4, 4> moment;
-    double sxx = 0, sxy = 0, sxz = 0, syx = 0, syy = 0, syz = 0, szx = 0, szy = 0, szz = 0;
-    sit = ps;
-    dit = pd;
-    for (size_t i = 0; i < numPoints; ++i, ++sit, ++dit)
+    if (numBones <= 64)
     {
-        sxx += (sit->x - XMVectorGetX(cs)) * (dit->x - XMVectorGetX(cd));
-        sxy += (sit->x - XMVectorGetX(cs)) * (dit->y - XMVectorGetY(cd));
-        sxz += (sit->x - XMVectorGetX(cs)) * (dit->z - XMVectorGetZ(cd));
-        syx += (sit->y - XMVectorGetY(cs)) * (dit->x - XMVectorGetX(cd));
-        syy += (sit->y - XMVectorGetY(cs)) * (dit->y - XMVectorGetY(cd));
-        syz += (sit->y - XMVectorGetY(cs)) * (dit->z - XMVectorGetZ(cd));
-        szx += (sit->z - XMVectorGetZ(cs)) * (dit->x - XMVectorGetX(cd));
-        szy += (sit->z - XMVectorGetZ(cs)) * (dit->y - XMVectorGetY(cd));
-        szz += (sit->z - XMVectorGetZ(cs)) * (dit->z - XMVectorGetZ(cd));
+        return UpdateWeightMapRange<64, NumIndices>;
     }
-    moment(0, 0) = sxx + syy + szz;
-    moment(0, 1) = syz - szy;        moment(1, 0) = moment(0, 1);
-    moment(0, 2) = szx - sxz;        moment(2, 0) = moment(0, 2);
-    moment(0, 3) = sxy - syx;        moment(3, 0) = moment(0, 3);
-    moment(1, 1) = sxx - syy - szz;
-    moment(1, 2) = sxy + syx;        moment(2, 1) = moment(1, 2);
-    moment(1, 3) = szx + sxz;        moment(3, 1) = moment(1, 3);
-    moment(2, 2) = -sxx + syy - szz;
-    moment(2, 3) = syz + szy;        moment(3, 2) = moment(2, 3);
-    moment(3, 3) = -sxx - syy + szz;
+    return UpdateWeightMapRange<Dynamic, NumIndices>;
+}
 
-    if (moment.norm() > 0)
+// 悭gCfNXE{[̑gݍ킹ɂ͓ꉻJ[lg
+WeightMapKernel SelectWeightMapKernel(int numBones, int numIndices)
+{
+    switch (numIndices)
     {
-        // tőŗLlɑΉŗLxNg擾
-        EigenSolver<Matrix<double, 4, 4>> es(moment);
-        int maxi = 0;
-        for (int i = 1; i < 4; ++i)
-        {
-            if (es.eigenvalues()(maxi).real() < es.eigenvalues()(i).real())
-            {
-                maxi = i;
-            }
-        }
-        transform.Rotation() = XMFLOAT4A(
-            static_cast<float>(es.eigenvectors()(1, maxi).real()),
-            static_cast<float>(es.eigenvectors()(2, maxi).real()),
-            static_cast<float>(es.eigenvectors()(3, maxi).real()),
-            static_cast<float>(es.eigenvectors()(0, maxi).real()));
+    case 4:
+        return SelectWeightMapKernel<4>(numBones);
+    case 8:
+        return SelectWeightMapKernel<8>(numBones);
+    default:
+        return SelectWeightMapKernel<Dynamic>(numBones);
     }
-
-    // sړ
-    //
-    XMVECTOR cs0 = transform.TransformCoord(cs);
-    XMStoreFloat3A(&transform.Translation(), cd - cs0);
-    return transform;
 }
 
-// xxx.9F\tilde{q}_{j,n}
-void ComputeExamplePoints(std::vector<XMFLOAT3A>& example, int sid, int bone, const Output& output, const Input& input, const Parameter& param)
+// ˉez@ł܂Ƃ߂ĉ_iz̓[œɒuC[̃[vSIMDj
+const int WeightBatchLanes = 8;
+
+// [zṔiw = 1Cw >= 0jɎˉeFw = max(z - , 0)
+// т Michelot ̕@ŋ߂i = (_{z_b > } z_b - 1) / |{b | z_b > }| PɍXVCXnŎj
+void ProjectSimplexBatch(double* w, const double* z, int n)
 {
-    const int numVertices = input.numVertices;
-    const int numIndices = param.numIndices;
-    const int numBones = output.numBones;
-    for (int v = 0; v < numVertices; ++v)
+    const int L = WeightBatchLanes;
+    double tau[L], sum[L], count[L];
+    for (int l = 0; l < L; ++l)
     {
-        example[v] = input.sample[sid * numVertices + v];
-        const XMVECTOR s = XMLoadFloat3A(&input.bindModel[v]);
-        for (int i = 0; i < numIndices; ++i)
+        sum[l] = 0;
+    }
+    for (int b = 0; b < n; ++b)
+    {
+        for (int l = 0; l < L; ++l)
         {
-            const int b = output.index[v * numIndices + i];
-            if (b != bone)
-            {
-                const float w = output.weight[v * numIndices + i];
-                const RigidTransform& at = output.boneTrans[sid * numBones + b];
-                XMVECTOR r = XMLoadFloat3A(&example[v]);
-                XMStoreFloat3A(&example[v], r - w * at.TransformCoord(s));
-            }
+            sum[l] += z[b * L + l];
         }
     }
-}
-
-void SubtractCentroid(std::vector<XMFLOAT3A>& model, std::vector<XMFLOAT3A>& example, XMFLOAT3A& corModel, XMFLOAT3A& corExample, const VectorXd& weight, const Output& output, const Input& input)
-{
-    const int numVertices = input.numVertices;
-
-    // xxx.10F\bar{p}_nC\bar{q}_{j,n}
-    double wsqsum = 0;
-    XMVECTOR dmodel = XMVectorZero();
-    XMVECTOR dexample = XMVectorZero();
-    for (int v = 0; v < numVertices; ++v)
+    for (int l = 0; l < L; ++l)
     {
-        const double w = weight[v];
-        dmodel += static_cast<float>(w * w) * XMLoadFloat3A(&input.bindModel[v]);
-        dexample += static_cast<float>(w)* XMLoadFloat3A(&example[v]);
-        wsqsum += w * w;
+        tau[l] = (sum[l] - 1.0) / n;
     }
-    dmodel /= static_cast<float>(wsqsum);
-    dexample /= static_cast<float>(wsqsum);
-    XMStoreFloat3A(&corModel, dmodel);
-    XMStoreFloat3A(&corExample, dexample);
-
-    for (int v = 0; v < numVertices; ++v)
+    for (int it = 0; it < n; ++it)
+    {
+        for (int l = 0; l < L; ++l)
+        {
+            sum[l] = 0;
+            count[l] = 0;
+        }
+        for (int b = 0; b < n; ++b)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                const bool active = z[b * L + l] > tau[l];
+                sum[l] += active ? z[b * L + l] : 0.0;
+                count[l] += active ? 1.0 : 0.0;
+            }
+        }
+        bool converged = true;
+        for (int l = 0; l < L; ++l)
+        {
+            const double next = (sum[l] - 1.0) / count[l];
+            converged = converged && (next <= tau[l]);
+            tau[l] = std::max(tau[l], next);
+        }
+        if (converged)
+        {
+            break;
+        }
+    }
+    for (int b = 0; b < n; ++b)
     {
-        // xxx.11Fw_{j,c} p_j
-        XMVECTOR d = XMLoadFloat3A(&input.bindModel[v]) - XMLoadFloat3A(&corModel);
-        XMStoreFloat3A(&model[v], static_cast<float>(weight[v]) * d);
-        // xxx.11Fq_{j,n}
-        d = XMLoadFloat3A(&example[v]) - static_cast<float>(weight[v]) * XMLoadFloat3A(&corExample);
-        XMStoreFloat3A(&example[v], d);
+        for (int l = 0; l < L; ++l)
+        {
+            w[b * L + l] = std::max(z[b * L + l] - tau[l], 0.0);
+        }
     }
 }
 
-#ifdef ENABLE_TBB
-class BoneTransformUpdator
+// [ min 1/2 w^T G w + g^T wiP̐jFISTAŉDw͏l󂯎Ԃ
+// gm[(b * n + c) * L + l]Cgv[b * L + l]Cw[b * L + l]Cwork 3 * n * L vf
+void SolveSimplexQPBatch(double* w, const double* gm, const double* gv, int n, int numIterations, double* work)
 {
-private:
-    Output* output;
-    const Input* input;
-    const Parameter* param;
-    const VectorXd* weight;
-    int bone;
-public:
-    BoneTransformUpdator(Output* output_, const Input* input_, const Parameter* param_, const VectorXd* weight_)
-        : bone(0), output(output_), input(input_), param(param_), weight(weight_)
+    const int L = WeightBatchLanes;
+    double* y = work;
+    double* z = work + n * L;
+    double* prev = work + 2 * n * L;
+
+    // zLipschitz萔Fs̐ΒlaɂEƁCׂ@ɂőŗLl̐̏
+    double invLip[L], bound[L], norm[L];
+    for (int l = 0; l < L; ++l)
     {
+        bound[l] = 0;
     }
-    void ChangeBone(int b)
+    for (int b = 0; b < n; ++b)
     {
-        bone = b;
+        double rowSum[L] = {};
+        for (int c = 0; c < n; ++c)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                rowSum[l] += std::abs(gm[(b * n + c) * L + l]);
+            }
+        }
+        for (int l = 0; l < L; ++l)
+        {
+            bound[l] = std::max(bound[l], rowSum[l]);
+        }
     }
-    void operator () (const tbb::blocked_range<int>& range) const
+    for (int b = 0; b < n; ++b)
     {
-        std::vector<XMFLOAT3A> model(input->numVertices), example(input->numVertices);
-        for (int s = range.begin(); s != range.end(); ++s)
+        for (int l = 0; l < L; ++l)
         {
-            // xxx.9F\tilde{q}_{j,n}
-            ComputeExamplePoints(example, s, bone, *output, *input, *param);
-
-            // xxx.10Cxxx.11
-            XMFLOAT3A corModel(0, 0, 0), corExample(0, 0, 0);
-            SubtractCentroid(model, example, corModel, corExample, *weight, *output, *input);
-
-            // xxx.12̉
-            RigidTransform transform = CalcPointsAlignment(model.size(), model.begin(), example.begin());
-            // xxx.13
-            XMVECTOR d = XMLoadFloat3A(&corExample) - transform.TransformCoord(XMLoadFloat3A(&corModel));
-            XMStoreFloat3A(&transform.Translation(), d + XMLoadFloat3A(&transform.Translation()));
-            output->boneTrans[s * output->numBones + bone] = transform;
+            y[b * L + l] = 1.0 + 0.618 * b - static_cast<int>(0.618 * b);
         }
     }
-};
-void UpdateBoneTransform(Output& output, const Input& input, const Parameter& param)
-{
-    const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
-    const int numBones = output.numBones;
-
-    VectorXd boneWeight = VectorXd::Zero(numVertices);
-    BoneTransformUpdator transformUpdator(&output, &input, &param, &boneWeight);
-    tbb::blocked_range<int> blockedRange(0, numExamples);
-    for (int bone = 0; bone < numBones; ++bone)
+    for (int it = 0; it < 8; ++it)
     {
-        for (int v = 0; v < numVertices; ++v)
+        for (int l = 0; l < L; ++l)
         {
-            boneWeight[v] = 0;
-            for (int i = 0; i < numIndices; ++i)
+            norm[l] = 0;
+        }
+        for (int b = 0; b < n; ++b)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                z[b * L + l] = 0;
+            }
+            for (int c = 0; c < n; ++c)
             {
-                if (output.index[v * numIndices + i] == bone)
+                for (int l = 0; l < L; ++l)
                 {
-                    boneWeight[v] = output.weight[v * numIndices + i];
-                    break;
+                    z[b * L + l] += gm[(b * n + c) * L + l] * y[c * L + l];
                 }
             }
+            for (int l = 0; l < L; ++l)
+            {
+                norm[l] += z[b * L + l] * z[b * L + l];
+            }
         }
-        transformUpdator.ChangeBone(bone);
+        for (int l = 0; l < L; ++l)
+        {
+            norm[l] = std::sqrt(norm[l]);
+        }
+        for (int b = 0; b < n; ++b)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                y[b * L + l] = z[b * L + l] / std::max(norm[l], std::numeric_limits<double>::min());
+            }
+        }
+    }
+    for (int l = 0; l < L; ++l)
+    {
+        // ׂ@͍őŗLl߂Â̂ŗ]T
+        invLip[l] = 1.0 / std::max(std::min(bound[l], 1.25 * norm[l]), std::numeric_limits<double>::min());
+    }
+
+    std::copy(w, w + n * L, y);
+    double t = 1;
+    for (int it = 0; it < numIterations; ++it)
+    {
+        // z = y - (G y + g) / Lip
+        for (int b = 0; b < n; ++b)
+        {
+            double grad[L];
+            for (int l = 0; l < L; ++l)
+            {
+                grad[l] = gv[b * L + l];
+            }
+            for (int c = 0; c < n; ++c)
+            {
+                for (int l = 0; l < L; ++l)
+                {
+                    grad[l] += gm[(b * n + c) * L + l] * y[c * L + l];
+                }
+            }
+            for (int l = 0; l < L; ++l)
+            {
+                z[b * L + l] = y[b * L + l] - grad[l] * invLip[l];
+            }
+        }
+        std::copy(w, w + n * L, prev);
+        ProjectSimplexBatch(w, z, n);
+
+        const double tNext = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * t * t));
+        const double beta = (t - 1.0) / tNext;
+        for (int i = 0; i < n * L; ++i)
+        {
+            y[i] = w[i] + beta * (w[i] - prev[i]);
+        }
+        t = tNext;
+    }
+}
+
+// ƖڕWʒu{[Ԃ̕mƂOsōs
+// r_b = (1/n)_c G_bcC = (1/n)_b r_bC\bar{g} = (1/n)_c g_c Ƃ
+// G'_bc = G_bc - r_b - r_c + ʁCg'_b = g_b + r_b - \bar{g} - 
+void CenterGramBatch(double* gm, double* gv, int n)
+{
+    const int L = WeightBatchLanes;
+    std::vector<double> r(n * L, 0.0);
+    double mu[L] = {}, gbar[L] = {};
+    for (int b = 0; b < n; ++b)
+    {
+        for (int c = 0; c < n; ++c)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                r[b * L + l] += gm[(b * n + c) * L + l];
+            }
+        }
+        for (int l = 0; l < L; ++l)
+        {
+            r[b * L + l] /= n;
+            mu[l] += r[b * L + l] / n;
+            gbar[l] += gv[b * L + l] / n;
+        }
+    }
+    for (int b = 0; b < n; ++b)
+    {
+        for (int c = 0; c < n; ++c)
+        {
+            for (int l = 0; l < L; ++l)
+            {
+                gm[(b * n + c) * L + l] += mu[l] - r[b * L + l] - r[c * L + l];
+            }
+        }
+        for (int l = 0; l < L; ++l)
+        {
+            gv[b * L + l] += r[b * L + l] - gbar[l] - mu[l];
+        }
+    }
+}
+
+// _͈[begin, end)̃XLjOEFCgXViˉez@ɂߎj
+// WeightBatchLanes̒_̖𓯎ɉCnumIndices̃{[œlɉ
+// l݂͌̃EFCgg
+void UpdateWeightMapBatchRange(int begin, int end, Output& output, const Input& input, const Parameter& param, const BonePairMoments* moments, const SkinningPalette& palette)
+{
+    const int L = WeightBatchLanes;
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+    const int numRows = numExamples * 3;
+    const int numSubBones = std::min(numIndices, numBones);
+    const int numIterations = param.numWeightGradientIterations;
+
+    const int numBasisRows = (moments != nullptr) ? 0 : numRows;
+    std::vector<double> am(numBones * numBasisRows * L), bv(numBasisRows * L);
+    std::vector<double> gm(numBones * numBones * L), gv(numBones * L), weight(numBones * L), work(3 * numBones * L);
+    std::vector<double> sgm(numSubBones * numSubBones * L), sgv(numSubBones * L), sweight(numSubBones * L);
+    std::vector<int> subIndex(numSubBones * L);
+    std::vector<float> tx(numBones), ty(numBones), tz(numBones);
+
+    for (int v0 = begin; v0 < end; v0 += L)
+    {
+        // ͈͊Õ[͍Ō̒_Ŗ߁Cʂ͏߂Ȃ
+        int lane[L];
+        for (int l = 0; l < L; ++l)
+        {
+            lane[l] = std::min(v0 + l, end - 1);
+        }
+
+        for (int l = 0; l < L; ++l)
+        {
+            const int v = lane[l];
+            if (moments != nullptr)
+            {
+                const Vector3d p(input.bindModel[v].x, input.bindModel[v].y, input.bindModel[v].z);
+                for (int b = 0; b < numBones; ++b)
+                {
+                    for (int c = b; c < numBones; ++c)
+                    {
+                        gm[(b * numBones + c) * L + l] = gm[(c * numBones + b) * L + l] = BonePairGram(*moments, b, c, p);
+                    }
+                    gv[b * L + l] = -BoneSampleDot(*moments, b, v, p, input);
+                }
+            }
+            else
+            {
+                for (int s = 0; s < numExamples; ++s)
+                {
+                    palette.TransformCoord(tx.data(), ty.data(), tz.data(), s * numBones, numBones, input.bindModel[v]);
+                    for (int b = 0; b < numBones; ++b)
+                    {
+                        am[(b * numRows + s * 3 + 0) * L + l] = tx[b];
+                        am[(b * numRows + s * 3 + 1) * L + l] = ty[b];
+                        am[(b * numRows + s * 3 + 2) * L + l] = tz[b];
+                    }
+                    XMFLOAT3 q;
+                    XMStoreFloat3(&q, input.LoadSample(s, v));
+                    bv[(s * 3 + 0) * L + l] = q.x;
+                    bv[(s * 3 + 1) * L + l] = q.y;
+                    bv[(s * 3 + 2) * L + l] = q.z;
+                }
+            }
+            // ݂̃EFCgn߂iΈlj
+            float weightSum = 0;
+            for (int b = 0; b < numBones; ++b)
+            {
+                weight[b * L + l] = 0;
+            }
+            for (int i = 0; i < numIndices; ++i)
+            {
+                weight[output.index[v * numIndices + i] * L + l] += output.weight[v * numIndices + i];
+                weightSum += output.weight[v * numIndices + i];
+            }
+            for (int b = 0; b < numBones; ++b)
+            {
+                weight[b * L + l] = (weightSum > 0) ? weight[b * L + l] / weightSum : 1.0 / numBones;
+            }
+        }
+
+        // w = 1 Ȃ̂Ŋe{[̕ϊʒuƖڕWʒu瓯_ĂړI֐͕ςȂ
+        // {[Ԃ̕ςċʐCz@̏
+        if (moments != nullptr)
+        {
+            CenterGramBatch(gm.data(), gv.data(), numBones);
+        }
+        else
+        {
+            for (int j = 0; j < numRows; ++j)
+            {
+                double mean[L] = {};
+                for (int b = 0; b < numBones; ++b)
+                {
+                    for (int l = 0; l < L; ++l)
+                    {
+                        mean[l] += am[(b * numRows + j) * L + l];
+                    }
+                }
+                for (int l = 0; l < L; ++l)
+                {
+                    mean[l] /= numBones;
+                    bv[j * L + l] -= mean[l];
+                }
+                for (int b = 0; b < numBones; ++b)
+                {
+                    for (int l = 0; l < L; ++l)
+                    {
+                        am[(b * numRows + j) * L + l] -= mean[l];
+                    }
+                }
+            }
+
+            // G = A * A^TCg = -A * b
+            for (int b = 0; b < numBones; ++b)
+            {
+                for (int c = b; c < numBones; ++c)
+                {
+                    double dot[L] = {};
+                    for (int j = 0; j < numRows; ++j)
+                    {
+                        for (int l = 0; l < L; ++l)
+                        {
+                            dot[l] += am[(b * numRows + j) * L + l] * am[(c * numRows + j) * L + l];
+                        }
+                    }
+                    for (int l = 0; l < L; ++l)
+                    {
+                        gm[(b * numBones + c) * L + l] = dot[l];
+                        gm[(c * numBones + b) * L + l] = dot[l];
+                    }
+                }
+                double dot[L] = {};
+                for (int j = 0; j < numRows; ++j)
+                {
+                    for (int l = 0; l < L; ++l)
+                    {
+                        dot[l] += am[(b * numRows + j) * L + l] * bv[j * L + l];
+                    }
+                }
+                for (int l = 0; l < L; ++l)
+                {
+                    gv[b * L + l] = -dot[l];
+                }
+            }
+        }
+        SolveSimplexQPBatch(weight.data(), gm.data(), gv.data(), numBones, numIterations, work.data());
+
+        // numIndices̃{[ɍi
+        for (int l = 0; l < L; ++l)
+        {
+            float weightSum = 0;
+            for (int i = 0; i < numSubBones; ++i)
+            {
+                double maxw = -1;
+                int bestbone = 0;
+                for (int b = 0; b < numBones; ++b)
+                {
+                    if (weight[b * L + l] > maxw)
+                    {
+                        maxw = weight[b * L + l];
+                        bestbone = b;
+                    }
+                }
+                subIndex[i * L + l] = bestbone;
+                sweight[i * L + l] = maxw;
+                weightSum += static_cast<float>(maxw);
+                weight[bestbone * L + l] = -1;
+            }
+            for (int i = 0; i < numSubBones; ++i)
+            {
+                sweight[i * L + l] = (weightSum > 0) ? sweight[i * L + l] / weightSum : 1.0 / numSubBones;
+                sgv[i * L + l] = gv[subIndex[i * L + l] * L + l];
+                for (int k = 0; k < numSubBones; ++k)
+                {
+                    sgm[(i * numSubBones + k) * L + l] = gm[(subIndex[i * L + l] * numBones + subIndex[k * L + l]) * L + l];
+                }
+            }
+        }
+        SolveSimplexQPBatch(sweight.data(), sgm.data(), sgv.data(), numSubBones, numIterations, work.data());
+
+        for (int l = 0; l < L && v0 + l < end; ++l)
+        {
+            const int v = v0 + l;
+            for (int i = 0; i < numIndices; ++i)
+            {
+                // subIndex݂͌ɈقȂ̂ŁCEFCg0̃CfNX̂܂܏߂
+                output.index[v * numIndices + i] = (i < numSubBones) ? subIndex[i * L + l] : 0;
+                output.weight[v * numIndices + i] = (i < numSubBones) ? static_cast<float>(sweight[i * L + l]) : 0.0f;
+            }
+        }
+    }
+}
+
+// batchedFˉez@ŕ_܂Ƃ߂ċߎIɉ
+// palette͔܂ŕێCω{[p̍ŝݍXV
+void UpdateWeightMap(Output& output, const Input& input, const Parameter& param, bool batched, SkinningPalette& palette)
+{
+    // {[΂̃[g͔Ɉx߁CS_ŋL
+    // ԕ̊ꂪꍇ͏Ƀ[gg
+    BonePairMoments pairMoments;
+    const BonePairMoments* moments = nullptr;
+    if (param.useBonePairMoments || input.temporalRank > 0)
+    {
+        ComputeBonePairMoments(pairMoments, output, input);
+        moments = &pairMoments;
+    }
+    else
+    {
+        palette.Update(output.boneTrans);
+    }
+
+    if (batched)
+    {
+#ifdef ENABLE_TBB
+        tbb::parallel_for(tbb::blocked_range<int>(0, input.numVertices, WeightBatchLanes * 4),
+            [&](const tbb::blocked_range<int>& range)
+        {
+            UpdateWeightMapBatchRange(range.begin(), range.end(), output, input, param, moments, palette);
+        });
+#else
+        UpdateWeightMapBatchRange(0, input.numVertices, output, input, param, moments, palette);
+#endif //ENABLE_TBB
+        return;
+    }
+
+    const WeightConstraints constraints(output.numBones, param.numIndices);
+    const WeightMapKernel kernel = SelectWeightMapKernel(output.numBones, param.numIndices);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numVertices),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        kernel(range.begin(), range.end(), output, input, param, constraints, moments, palette);
+    });
+#else
+    kernel(0, input.numVertices, output, input, param, constraints, moments, palette);
+#endif //ENABLE_TBB
+}
+
+// Xgxxx.13FHorn̓_Qʒu킹ASY
+// dScsCcdƁCdS_̑݋U cross =  (s - cs)(d - cd)^T 獄̕ϊ߂
+RigidTransform CalcAlignmentFromMoment(const Matrix3d& cross, const Vector3d& cs, const Vector3d& cd)
+{
+    RigidTransform transform;
+
+    // [gšvZ
+    const double sxx = cross(0, 0), sxy = cross(0, 1), sxz = cross(0, 2);
+    const double syx = cross(1, 0), syy = cross(1, 1), syz = cross(1, 2);
+    const double szx = cross(2, 0), szy = cross(2, 1), szz = cross(2, 2);
+    Matrix<double, 4, 4> moment;
+    moment(0, 0) = sxx + syy + szz;
+    moment(0, 1) = syz - szy;        moment(1, 0) = moment(0, 1);
+    moment(0, 2) = szx - sxz;        moment(2, 0) = moment(0, 2);
+    moment(0, 3) = sxy - syx;        moment(3, 0) = moment(0, 3);
+    moment(1, 1) = sxx - syy - szz;
+    moment(1, 2) = sxy + syx;        moment(2, 1) = moment(1, 2);
+    moment(1, 3) = szx + sxz;        moment(3, 1) = moment(1, 3);
+    moment(2, 2) = -sxx + syy - szz;
+    moment(2, 3) = syz + szy;        moment(3, 2) = moment(2, 3);
+    moment(3, 3) = -sxx - syy + szz;
+
+    if (moment.norm() > 0)
+    {
+        // tőŗLlɑΉŗLxNg擾iΏ̍sȂ̂ŌŗLl͏j
+        SelfAdjointEigenSolver<Matrix<double, 4, 4>> es(moment);
+        const Vector4d q = es.eigenvectors().col(3);
+        transform.Rotation() = XMFLOAT4A(static_cast<float>(q[1]), static_cast<float>(q[2]), static_cast<float>(q[3]), static_cast<float>(q[0]));
+    }
+
+    // sړ
+    const XMVECTOR cs0 = transform.TransformCoord(XMVectorSet(static_cast<float>(cs.x()), static_cast<float>(cs.y()), static_cast<float>(cs.z()), 0));
+    XMStoreFloat3A(&transform.Translation(), XMVectorSet(static_cast<float>(cd.x()), static_cast<float>(cd.y()), static_cast<float>(cd.z()), 0) - cs0);
+    return transform;
+}
+
+// Ή_QpsCpd̈ʒu킹
+// dSƑ݋U  s d^T - n cs cd^T Ƃ1pXŋ߂
+RigidTransform CalcPointsAlignment(size_t numPoints, std::vector<XMFLOAT3>::const_iterator ps, std::vector<XMFLOAT3>::const_iterator pd)
+{
+    if (numPoints == 0)
+    {
+        return RigidTransform();
+    }
+
+    // ꂼ̓_Q̏dSWƃ[ǧvZ
+    Vector3d ss = Vector3d::Zero(), sd = Vector3d::Zero();
+    Matrix3d sp = Matrix3d::Zero();
+    std::vector<XMFLOAT3>::const_iterator sit = ps;
+    std::vector<XMFLOAT3>::const_iterator dit = pd;
+    for (size_t i = 0; i < numPoints; ++i, ++sit, ++dit)
+    {
+        const Vector3d s(sit->x, sit->y, sit->z);
+        const Vector3d d(dit->x, dit->y, dit->z);
+        ss += s;
+        sd += d;
+        sp.noalias() += s * d.transpose();
+    }
+    const Vector3d cs = ss / static_cast<double>(numPoints);
+    const Vector3d cd = sd / static_cast<double>(numPoints);
+
+    // ]̐肪łȂ or ]𐄒肵Ȃꍇ͕sړ̂ݖ߂
+    if (numPoints < 3)
+    {
+        RigidTransform transform;
+        transform.Translation() = XMFLOAT3A(static_cast<float>(cd.x() - cs.x()), static_cast<float>(cd.y() - cs.y()), static_cast<float>(cd.z() - cs.z()));
+        return transform;
+    }
+    return CalcAlignmentFromMoment(sp - static_cast<double>(numPoints) * cs * cd.transpose(), cs, cd);
+}
+
+// {[e_ւ̋tiCSR`j
+// {[b̉e_ƃEFCg[offset[b], offset[b + 1])C_͏
+struct BoneVertexIndex
+{
+    std::vector<int> offset;
+    std::vector<int> vertex;
+    std::vector<float> weight;
+};
+
+// EFCg0łȂoCĥ݂𐔂グC_ɋl߂ivZʂ͒_ x CfNXj
+void BuildBoneVertexIndex(BoneVertexIndex& boneVertices, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+
+    boneVertices.offset.assign(numBones + 1, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            if (output.weight[v * numIndices + i] != 0)
+            {
+                ++boneVertices.offset[output.index[v * numIndices + i] + 1];
+            }
+        }
+    }
+    for (int b = 0; b < numBones; ++b)
+    {
+        boneVertices.offset[b + 1] += boneVertices.offset[b];
+    }
+    boneVertices.vertex.resize(boneVertices.offset[numBones]);
+    boneVertices.weight.resize(boneVertices.offset[numBones]);
+    std::vector<int> cursor(boneVertices.offset.begin(), boneVertices.offset.end() - 1);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const float w = output.weight[v * numIndices + i];
+            if (w == 0)
+            {
+                continue;
+            }
+            int& k = cursor[output.index[v * numIndices + i]];
+            boneVertices.vertex[k] = v;
+            boneVertices.weight[k] = w;
+            ++k;
+        }
+    }
+}
+
+// {[p̏dݕt[g
+// e_vɂ q~_v = q_v - _{ij} w_i T_i p_vixxx.9jƂCW =  w_v^2C w_v^2 p_vC w_v q~_vC w_v p_v q~_v^T
+struct BoneAlignmentMoments
+{
+    double weightSq;
+    Vector3d model;
+    Vector3d example;
+    Matrix3d cross;
+};
+
+// Ꭶf[^sidɂă{[bonẻe_̃[g1pXŗݐς
+template <int NumIndices>
+void AccumulateBoneMomentsKernel(BoneAlignmentMoments& moments, int sid, int bone, const BoneVertexIndex& boneVertices, const Output& output, const Input& input, const Parameter& param, const SkinningPalette& palette)
+{
+    const int numIndices = (NumIndices == Dynamic) ? param.numIndices : NumIndices;
+    const int numBones = output.numBones;
+    moments.weightSq = 0;
+    moments.model.setZero();
+    moments.example.setZero();
+    moments.cross.setZero();
+    for (int k = boneVertices.offset[bone]; k < boneVertices.offset[bone + 1]; ++k)
+    {
+        const int v = boneVertices.vertex[k];
+        const float w = boneVertices.weight[k];
+        const XMVECTOR p = input.LoadBindModel(v);
+        XMVECTOR q = input.LoadSample(sid, v);
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const int b = output.index[v * numIndices + i];
+            const float wi = output.weight[v * numIndices + i];
+            if (b != bone && wi != 0)
+            {
+                q -= wi * palette.TransformCoord(sid * numBones + b, p);
+            }
+        }
+        XMFLOAT3A qf;
+        XMStoreFloat3A(&qf, q);
+        const Vector3d pv(input.bindModel[v].x, input.bindModel[v].y, input.bindModel[v].z);
+        const Vector3d qv(qf.x, qf.y, qf.z);
+        moments.weightSq += static_cast<double>(w) * w;
+        moments.model += (static_cast<double>(w) * w) * pv;
+        moments.example += w * qv;
+        moments.cross.noalias() += (w * pv) * qv.transpose();
+    }
+}
+
+// xxx.10`xxx.13FdݕtdS p* =  w^2 p / WCq* =  w q~ / W 
+// ݋U  w (p - p*)(q~ - w q*)^T =  w p q~^T - W p* q*^T p߂
+// e_falseԂ
+bool FitBoneTransform(RigidTransform& transform, int sid, int bone, const BoneVertexIndex& boneVertices, const Output& output, const Input& input, const Parameter& param, const SkinningPalette& palette)
+{
+    BoneAlignmentMoments moments;
+    switch (param.numIndices)
+    {
+    case 4:
+        AccumulateBoneMomentsKernel<4>(moments, sid, bone, boneVertices, output, input, param, palette);
+        break;
+    case 8:
+        AccumulateBoneMomentsKernel<8>(moments, sid, bone, boneVertices, output, input, param, palette);
+        break;
+    default:
+        AccumulateBoneMomentsKernel<Dynamic>(moments, sid, bone, boneVertices, output, input, param, palette);
+        break;
+    }
+    if (moments.weightSq <= 0)
+    {
+        return false;
+    }
+    const Vector3d corModel = moments.model / moments.weightSq;
+    const Vector3d corExample = moments.example / moments.weightSq;
+    transform = CalcAlignmentFromMoment(moments.cross - moments.weightSq * corModel * corExample.transpose(), corModel, corExample);
+    return true;
+}
+
+#ifdef ENABLE_TBB
+class BoneTransformUpdator
+{
+private:
+    Output* output;
+    const Input* input;
+    const Parameter* param;
+    const BoneVertexIndex* boneVertices;
+    SkinningPalette* palette;
+    int bone;
+public:
+    BoneTransformUpdator(Output* output_, const Input* input_, const Parameter* param_, const BoneVertexIndex* boneVertices_, SkinningPalette* palette_)
+        : bone(0), output(output_), input(input_), param(param_), boneVertices(boneVertices_), palette(palette_)
+    {
+    }
+    void ChangeBone(int b)
+    {
+        bone = b;
+    }
+    void operator () (const tbb::blocked_range<int>& range) const
+    {
+        for (int s = range.begin(); s != range.end(); ++s)
+        {
+            RigidTransform transform;
+            if (FitBoneTransform(transform, s, bone, *boneVertices, *output, *input, *param, *palette))
+            {
+                output->boneTrans[s * output->numBones + bone] = transform;
+                palette->Set(s * output->numBones + bone, transform);
+            }
+        }
+    }
+};
+void UpdateBoneTransform(Output& output, const Input& input, const Parameter& param, const BoneVertexIndex& boneVertices, SkinningPalette& palette)
+{
+    const int numExamples = input.numExamples;
+    const int numBones = output.numBones;
+
+    // XV{[p͑{[̍XVŎĝŁC̓sxpaletteɔf
+    palette.Update(output.boneTrans);
+    BoneTransformUpdator transformUpdator(&output, &input, &param, &boneVertices, &palette);
+    tbb::blocked_range<int> blockedRange(0, numExamples);
+    for (int bone = 0; bone < numBones; ++bone)
+    {
+        transformUpdator.ChangeBone(bone);
         tbb::parallel_for(blockedRange, transformUpdator);
     }
 }
-#else
-void UpdateBoneTransform(Output& output, const Input& input, const Parameter& param)
-{
-    const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
-    const int numBones = output.numBones;
+#else
+void UpdateBoneTransform(Output& output, const Input& input, const Parameter& param, const BoneVertexIndex& boneVertices, SkinningPalette& palette)
+{
+    const int numExamples = input.numExamples;
+    const int numBones = output.numBones;
+
+    palette.Update(output.boneTrans);
+    for (int bone = 0; bone < numBones; ++bone)
+    {
+        for (int s = 0; s < numExamples; ++s)
+        {
+            RigidTransform transform;
+            if (FitBoneTransform(transform, s, bone, boneVertices, output, input, param, palette))
+            {
+                output.boneTrans[s * output.numBones + bone] = transform;
+                palette.Set(s * output.numBones + bone, transform);
+            }
+        }
+    }
+}
+#endif
+bool UpdateBoneTransform(std::vector<RigidTransform>& boneTrans, int numBones, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+
+    std::vector<int> numBoneVertices(numBones, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        ++numBoneVertices[output.index[v * numIndices + 0]];
+    }
+    std::vector<int> boneVertexId(numBones, 0);
+    for (int i = 1; i < numBones; ++i)
+    {
+        boneVertexId[i] = boneVertexId[i - 1] + numBoneVertices[i - 1];
+    }
+    // {[ɒ_l߂ĕׂ
+    std::vector<int> vertexSlot(numVertices, 0);
+    std::vector<XMFLOAT3> skin(numVertices, XMFLOAT3(0, 0, 0));
+    std::vector<XMFLOAT3> anim(numVertices, XMFLOAT3(0, 0, 0));
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int bs = output.index[v * numIndices + 0];
+        vertexSlot[v] = boneVertexId[bs]++;
+        skin[vertexSlot[v]] = input.bindModel[v];
+    }
+    boneVertexId[0] = 0;
+    for (int i = 1; i < numBones; ++i)
+    {
+        boneVertexId[i] = boneVertexId[i - 1] + numBoneVertices[i - 1];
+    }
+    for (int s = 0; s < numExamples; ++s)
+    {
+        // ǂݍݒ̗Ꭶf[^͓҂Ă珈
+        if (!input.WaitExample(s))
+        {
+            return false;
+        }
+        for (int v = 0; v < numVertices; ++v)
+        {
+            XMStoreFloat3(&anim[vertexSlot[v]], input.LoadSample(s, v));
+        }
+        for (int b = 0; b < numBones; ++b)
+        {
+            boneTrans[s * numBones + b] = CalcPointsAlignment(numBoneVertices[b], skin.begin() + boneVertexId[b], anim.begin() + boneVertexId[b]);
+        }
+    }
+    return true;
+}
+
+// S{[XV̘A̍\iEFCgςȂԂ͗Ꭶf[^ɂȂj
+struct JointBoneSystem
+{
+    //! {[(s{[ >= {[)6x6ubN
+    std::vector<std::pair<int, int>> blockBones;
+    //! _̃CfNXi,jZubNi_ x CfNX x CfNXj
+    std::vector<int> vertexBlock;
+};
+
+void BuildJointBoneSystem(JointBoneSystem& system, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+
+    std::vector<long long> keys;
+    for (int b = 0; b < numBones; ++b)
+    {
+        // êȂ{[ΊpubNČWs𐳑ɕۂ
+        keys.push_back(static_cast<long long>(b) * numBones + b);
+    }
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            for (int j = 0; j < numIndices; ++j)
+            {
+                const int bi = output.index[v * numIndices + i];
+                const int bj = output.index[v * numIndices + j];
+                if (output.weight[v * numIndices + i] != 0 && output.weight[v * numIndices + j] != 0 && bi >= bj)
+                {
+                    keys.push_back(static_cast<long long>(bi) * numBones + bj);
+                }
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    system.blockBones.resize(keys.size());
+    for (size_t k = 0; k < keys.size(); ++k)
+    {
+        system.blockBones[k] = std::make_pair(static_cast<int>(keys[k] / numBones), static_cast<int>(keys[k] % numBones));
+    }
+    system.vertexBlock.assign(numVertices * numIndices * numIndices, -1);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            for (int j = 0; j < numIndices; ++j)
+            {
+                const int bi = output.index[v * numIndices + i];
+                const int bj = output.index[v * numIndices + j];
+                if (output.weight[v * numIndices + i] != 0 && output.weight[v * numIndices + j] != 0 && bi >= bj)
+                {
+                    const long long key = static_cast<long long>(bi) * numBones + bj;
+                    system.vertexBlock[(v * numIndices + i) * numIndices + j] = static_cast<int>(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+                }
+            }
+        }
+    }
+}
+
+// Ꭶf[^s̃{[pispalettejɑ΂ߎ덷̓a
+double ComputePoseErrorSq(const SkinningPalette& palette, int s, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    double rsqsum = 0;
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const XMVECTOR residual = ComputeResidual(s, v, 0, output, input, numIndices, palette);
+        rsqsum += XMVectorGetX(XMVector3LengthSq(residual));
+    }
+    return rsqsum;
+}
+
+// Ꭶf[^͈[begin, end)̃{[pLevenberg-Marquardt@őS{[ɍXV
+// {[b̍XVʂ͍̔]_bƕsړt_bŁCR_b' = exp([_b]x) R_bCt_b' = t_b + t_b
+// _ṽf_̕ω _i w_i (_{b_i} x u_i + t_{b_i})Cu_i = R_{b_i} p_v
+void UpdateBoneTransformJointRange(int begin, int end, Output& output, const Input& input, const Parameter& param, const JointBoneSystem& system)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+    const int numBlocks = static_cast<int>(system.blockBones.size());
+    const int numSteps = param.numJointUpdateSteps;
+    const int numTrials = param.numJointUpdateTrials;
+
+    std::vector<Triplet<double>> triplets;
+    triplets.reserve(numBlocks * 36);
+    SparseMatrix<double> hessian(numBones * 6, numBones * 6);
+    SimplicialLDLT<SparseMatrix<double>> solver;
+    MatrixXd blocks(6, numBlocks * 6);
+    VectorXd gradient(numBones * 6), delta(numBones * 6);
+    std::vector<RigidTransform> candidate(numBones);
+    SkinningPalette pose, trialPose;
+    std::vector<XMFLOAT3A> u(numIndices);
+    bool analyzed = false;
+
+    for (int s = begin; s < end; ++s)
+    {
+        RigidTransform* boneTrans = &output.boneTrans[s * numBones];
+        double lambda = 1e-3;
+        for (int step = 0; step < numSteps; ++step)
+        {
+            // K J^T J  = J^T r ̑gݗ
+            pose.Update(boneTrans, numBones);
+            blocks.setZero();
+            gradient.setZero();
+            double rsqsum = 0;
+            for (int v = 0; v < numVertices; ++v)
+            {
+                const XMVECTOR p = input.LoadBindModel(v);
+                XMVECTOR residual = input.LoadSample(s, v);
+                for (int i = 0; i < numIndices; ++i)
+                {
+                    const float w = output.weight[v * numIndices + i];
+                    if (w != 0)
+                    {
+                        const int bi = output.index[v * numIndices + i];
+                        const XMVECTOR ui = pose.Rotate(bi, p);
+                        XMStoreFloat3A(&u[i], ui);
+                        residual -= w * (ui + XMLoadFloat3A(&boneTrans[bi].Translation()));
+                    }
+                }
+                rsqsum += XMVectorGetX(XMVector3LengthSq(residual));
+                XMFLOAT3A r;
+                XMStoreFloat3A(&r, residual);
+                const Vector3d rv(r.x, r.y, r.z);
+
+                for (int i = 0; i < numIndices; ++i)
+                {
+                    const double wi = output.weight[v * numIndices + i];
+                    if (wi == 0)
+                    {
+                        continue;
+                    }
+                    const Vector3d ui(u[i].x, u[i].y, u[i].z);
+                    const int bi = output.index[v * numIndices + i];
+                    // J_i^T r = w_i (u_i x r, r)
+                    gradient.segment<3>(bi * 6) += wi * ui.cross(rv);
+                    gradient.segment<3>(bi * 6 + 3) += wi * rv;
+                    for (int j = 0; j < numIndices; ++j)
+                    {
+                        const int k = system.vertexBlock[(v * numIndices + i) * numIndices + j];
+                        if (k < 0)
+                        {
+                            continue;
+                        }
+                        // J_i^T J_j = w_i w_j [-[u_i]x [u_j]x, [u_i]x; -[u_j]x, I]
+                        const double ww = wi * output.weight[v * numIndices + j];
+                        const Vector3d uj(u[j].x, u[j].y, u[j].z);
+                        Matrix3d ci, cj;
+                        ci << 0, -ui.z(), ui.y(), ui.z(), 0, -ui.x(), -ui.y(), ui.x(), 0;
+                        cj << 0, -uj.z(), uj.y(), uj.z(), 0, -uj.x(), -uj.y(), uj.x(), 0;
+                        auto block = blocks.block<6, 6>(0, k * 6);
+                        block.topLeftCorner<3, 3>() -= ww * ci * cj;
+                        block.topRightCorner<3, 3>() += ww * ci;
+                        block.bottomLeftCorner<3, 3>() -= ww * cj;
+                        block.bottomRightCorner<3, 3>().diagonal().array() += ww;
+                    }
+                }
+            }
+
+            // Ws̉Op
+            triplets.clear();
+            double diagonalMean = 0;
+            for (int k = 0; k < numBlocks; ++k)
+            {
+                const int br = system.blockBones[k].first;
+                const int bc = system.blockBones[k].second;
+                for (int c = 0; c < 6; ++c)
+                {
+                    for (int r = (br == bc) ? c : 0; r < 6; ++r)
+                    {
+                        triplets.push_back(Triplet<double>(br * 6 + r, bc * 6 + c, blocks(r, k * 6 + c)));
+                    }
+                    if (br == bc)
+                    {
+                        diagonalMean += blocks(c, k * 6 + c);
+                    }
+                }
+            }
+            diagonalMean /= numBones * 6;
+            hessian.setFromTriplets(triplets.begin(), triplets.end());
+            if (!analyzed)
+            {
+                solver.analyzePattern(hessian);
+                analyzed = true;
+            }
+            const VectorXd diagonal = hessian.diagonal();
+
+            bool accepted = false;
+            for (int trial = 0; trial < numTrials && !accepted; ++trial)
+            {
+                // (J^T J +  diag(J^T J))  = J^T rCêȂ{[͔ȐŃ = 0ɂȂ
+                for (int i = 0; i < numBones * 6; ++i)
+                {
+                    hessian.coeffRef(i, i) = diagonal[i] * (1.0 + lambda) + 1e-12 * diagonalMean + 1e-30;
+                }
+                solver.factorize(hessian);
+                if (solver.info() != Success)
+                {
+                    lambda *= 10;
+                    continue;
+                }
+                delta = solver.solve(gradient);
+                for (int b = 0; b < numBones; ++b)
+                {
+                    const Vector3d dr = delta.segment<3>(b * 6);
+                    const double angle = dr.norm();
+                    const double scale = (angle > 1e-12) ? std::sin(angle * 0.5) / angle : 0.5;
+                    const XMVECTOR dq = XMVectorSet(static_cast<float>(dr.x() * scale), static_cast<float>(dr.y() * scale), static_cast<float>(dr.z() * scale), static_cast<float>(std::cos(angle * 0.5)));
+                    // ̉]̌dqKp
+                    const XMVECTOR q = XMQuaternionNormalize(XMQuaternionMultiply(XMLoadFloat4A(&boneTrans[b].Rotation()), dq));
+                    XMStoreFloat4A(&candidate[b].Rotation(), q);
+                    candidate[b].Translation() = XMFLOAT3A(
+                        boneTrans[b].Translation().x + static_cast<float>(delta[b * 6 + 3]),
+                        boneTrans[b].Translation().y + static_cast<float>(delta[b * 6 + 4]),
+                        boneTrans[b].Translation().z + static_cast<float>(delta[b * 6 + 5]));
+                }
+                trialPose.Update(candidate);
+                if (ComputePoseErrorSq(trialPose, s, output, input, param) < rsqsum)
+                {
+                    std::copy(candidate.begin(), candidate.end(), boneTrans);
+                    lambda = std::max(lambda * 0.1, 1e-7);
+                    accepted = true;
+                }
+                else
+                {
+                    lambda *= 10;
+                }
+            }
+            if (!accepted)
+            {
+                break;
+            }
+        }
+    }
+}
+
+void UpdateBoneTransformJoint(Output& output, const Input& input, const Parameter& param)
+{
+    JointBoneSystem system;
+    BuildJointBoneSystem(system, output, input, param);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numExamples),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        UpdateBoneTransformJointRange(range.begin(), range.end(), output, input, param, system);
+    });
+#else
+    UpdateBoneTransformJointRange(0, input.numExamples, output, input, param, system);
+#endif //ENABLE_TBB
+}
+
+int BindVertexToBone(Output& output, std::vector<RigidTransform>& boneTrans, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+    int numBones = static_cast<int>(boneTrans.size() / numExamples);
+
+    std::vector<int> numBoneVertices(numBones, 0);
+    std::vector<float> vertexError(numVertices, 0);
+    SkinningPalette palette;
+    palette.Update(boneTrans);
+
+    for (int v = 0; v < numVertices; ++v)
+    {
+        int bestBone = 0;
+        float minErr = std::numeric_limits<float>::max();
+        const XMVECTOR bindModelPos = input.LoadBindModel(v);
+        for (int b = 0; b < numBones; ++b)
+        {
+            float errsq = 0;
+            for (int s = 0; s < numExamples; ++s)
+            {
+                XMVECTOR diff = input.LoadSample(s, v)
+                              - palette.TransformCoord(s * numBones + b, bindModelPos);
+                errsq += XMVectorGetX(XMVector3LengthSq(diff));
+            }
+            if (errsq < minErr)
+            {
+                bestBone = b;
+                minErr = errsq;
+            }
+        }
+        ++numBoneVertices[bestBone];
+        output.index[v * numIndices + 0] = bestBone;
+        vertexError[v] = minErr;
+    }
+
+    // NX^̏
+    std::vector<int>::iterator smallestBoneSize = std::min_element(numBoneVertices.begin(), numBoneVertices.end());
+    while (*smallestBoneSize <= 0)
+    {
+        const int smallestBone = static_cast<int>(smallestBoneSize - numBoneVertices.begin());
+        numBoneVertices.erase(numBoneVertices.begin() + smallestBone);
+        for (int s = input.numExamples - 1; s >= 0; --s)
+        {
+            boneTrans.erase(boneTrans.begin() + s * numBones + smallestBone);
+        }
+        for (int v = 0; v < numVertices; ++v)
+        {
+            int b = output.index[v * numIndices + 0];
+            if (b >= smallestBone)
+            {
+                --output.index[v * numIndices + 0];
+            }
+        }
+        --numBones;
+        smallestBoneSize = std::min_element(numBoneVertices.begin(), numBoneVertices.end());
+    }
+    return static_cast<int>(numBoneVertices.size());
+}
+
+// NX^̕Fsplit[c]̃NX^ŋߎ덷ƒS̋ł傫_VNX^ɂ
+// NX^ԍ̓CfNX0Ɋi[C̃NX^Ԃ
+// random^ꍇ́C덷Ƌ̐ςɔႷmőI
+int SplitClusters(Output& output, int numClusters, const std::vector<char>& split, const std::vector<float>& vertexError, const Input& input, const Parameter& param, std::mt19937* random)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+
+    std::vector<XMFLOAT3A> clusterCenter(numClusters, XMFLOAT3A(0, 0, 0));
+    std::vector<int> numBoneVertices(numClusters, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int c = output.index[v * numIndices + 0];
+        clusterCenter[c].x += input.bindModel[v].x;
+        clusterCenter[c].y += input.bindModel[v].y;
+        clusterCenter[c].z += input.bindModel[v].z;
+        ++numBoneVertices[c];
+    }
+    for (int c = 0; c < numClusters; ++c)
+    {
+        clusterCenter[c].x /= static_cast<float>(numBoneVertices[c]);
+        clusterCenter[c].y /= static_cast<float>(numBoneVertices[c]);
+        clusterCenter[c].z /= static_cast<float>(numBoneVertices[c]);
+    }
+
+    std::vector<float> maxClusterError(numClusters, -std::numeric_limits<float>::max());
+    std::vector<int> mostDistantVertex(numClusters, -1);
+    std::vector<double> sumClusterError(numClusters, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int c = output.index[v * numIndices + 0];
+        XMVECTOR d = input.LoadBindModel(v) - XMLoadFloat3A(&clusterCenter[c]);
+        float errSq = vertexError[v] * XMVectorGetX(XMVector3LengthSq(d));
+        if (errSq > maxClusterError[c])
+        {
+            maxClusterError[c] = errSq;
+            mostDistantVertex[c] = v;
+        }
+        sumClusterError[c] += errSq;
+    }
+    if (random != nullptr)
+    {
+        std::vector<double> threshold(numClusters);
+        for (int c = 0; c < numClusters; ++c)
+        {
+            threshold[c] = std::uniform_real_distribution<double>(0, sumClusterError[c])(*random);
+        }
+        std::vector<char> chosen(numClusters, 0);
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const int c = output.index[v * numIndices + 0];
+            if (chosen[c])
+            {
+                continue;
+            }
+            XMVECTOR d = input.LoadBindModel(v) - XMLoadFloat3A(&clusterCenter[c]);
+            threshold[c] -= vertexError[v] * XMVectorGetX(XMVector3LengthSq(d));
+            if (threshold[c] < 0)
+            {
+                mostDistantVertex[c] = v;
+                chosen[c] = 1;
+            }
+        }
+    }
+    int numPrevClusters = numClusters;
+    for (int c = 0; c < numPrevClusters; ++c)
+    {
+        if (split[c] && numBoneVertices[c] > 1)
+        {
+            output.index[mostDistantVertex[c] * numIndices + 0] = numClusters++;
+        }
+    }
+    return numClusters;
+}
+
+// NX^̕ƒ_̍Ċ蓖ĂJԂCnumMinBonesȏ̃NX^ɂ
+// boneTrans݂͌̃NX^iCfNX0j̎p
+// Ꭶf[^̓ǂݍ݂Ɏsꍇ0Ԃ
+int ClusterBones(Output& output, std::vector<RigidTransform>& boneTrans, int numClusters, const Input& input, const Parameter& param, std::mt19937* random)
+{
+    const int numVertices = input.numVertices;
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+
+    std::vector<float> vertexError(numVertices);
+    SkinningPalette palette;
+    while (numClusters < param.numMinBones)
+    {
+        palette.Update(boneTrans);
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const int c = output.index[v * numIndices + 0];
+            float sumApproxErrorSq = 0;
+            for (int s = 0; s < numExamples; ++s)
+            {
+                XMVECTOR diff = input.LoadSample(s, v)
+                    - palette.TransformCoord(s * numClusters + c, input.LoadBindModel(v));
+                sumApproxErrorSq += XMVectorGetX(XMVector3LengthSq(diff));
+            }
+            vertexError[v] = sumApproxErrorSq;
+        }
+        const int numPrevClusters = numClusters;
+        numClusters = SplitClusters(output, numClusters, std::vector<char>(numClusters, 1), vertexError, input, param, random);
+        if (numClusters == numPrevClusters)
+        {
+            break;
+        }
+        boneTrans.resize(numExamples * numClusters);
+
+        if (!UpdateBoneTransform(boneTrans, numClusters, output, input, param))
+        {
+            return 0;
+        }
+        numClusters = BindVertexToBone(output, boneTrans, input, param);
+    }
+    return numClusters;
+}
+
+// S_1̃NX^ɃoChC̎p߂iᎦf[^̓ǂݍ݂Ɏsfalsej
+bool BindToSingleCluster(Output& output, std::vector<RigidTransform>& boneTrans, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+
+    std::fill(output.index.begin(), output.index.end(), 0);
+    std::fill(output.weight.begin(), output.weight.end(), 0.0f);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        output.weight[v * numIndices + 0] = 1.0f;
+    }
+    output.numBones = 1;
+    boneTrans.resize(input.numExamples);
+    return UpdateBoneTransform(boneTrans, 1, output, input, param);
+}
+
+int ClusterInitialBones(Output& output, const Input& input, const Parameter& param)
+{
+    std::vector<RigidTransform> boneTrans;
+    if (!BindToSingleCluster(output, boneTrans, input, param))
+    {
+        return 0;
+    }
+    return ClusterBones(output, boneTrans, 1, input, param, nullptr);
+}
+
+// 10rbg̊erbg̊Ԃ2rbg0
+static unsigned int SpreadBits(unsigned int x)
+{
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// _̕בւFxz{[C{[̓oChWMortonR[h
+// order[i]͕בւiԖڂɗ錳̒_ԍ
+void ComputeVertexOrder(std::vector<int>& order, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+
+    XMVECTOR minCorner = XMVectorReplicate(std::numeric_limits<float>::max());
+    XMVECTOR maxCorner = XMVectorReplicate(-std::numeric_limits<float>::max());
+    for (int v = 0; v < numVertices; ++v)
+    {
+        minCorner = XMVectorMin(minCorner, input.LoadBindModel(v));
+        maxCorner = XMVectorMax(maxCorner, input.LoadBindModel(v));
+    }
+    const XMVECTOR extent = XMVectorMax(maxCorner - minCorner, XMVectorReplicate(std::numeric_limits<float>::min()));
+    const XMVECTOR scale = XMVectorReplicate(1023.0f) / extent;
+
+    std::vector<unsigned long long> key(numVertices);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const XMVECTOR cell = XMVectorMin((input.LoadBindModel(v) - minCorner) * scale, XMVectorReplicate(1023.0f));
+        const unsigned int morton = SpreadBits(static_cast<unsigned int>(XMVectorGetX(cell)))
+            | (SpreadBits(static_cast<unsigned int>(XMVectorGetY(cell))) << 1)
+            | (SpreadBits(static_cast<unsigned int>(XMVectorGetZ(cell))) << 2);
+        const float* weight = &output.weight[v * numIndices];
+        const int dominant = static_cast<int>(std::max_element(weight, weight + numIndices) - weight);
+        const unsigned long long bone = static_cast<unsigned int>(output.index[v * numIndices + dominant]);
+        key[v] = (bone << 32) | morton;
+    }
+    order.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        order[v] = v;
+    }
+    std::stable_sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] < key[b]; });
+}
+
+// _̕בւiorder[i]Ԗڂ̒_iԖڂցjuɕ̗݊
+void ComputeVertexSwaps(std::vector<std::pair<int, int>>& swaps, const std::vector<int>& order)
+{
+    const int numVertices = static_cast<int>(order.size());
+    std::vector<char> visited(numVertices, 0);
+    swaps.clear();
+    for (int i = 0; i < numVertices; ++i)
+    {
+        if (visited[i])
+        {
+            continue;
+        }
+        visited[i] = 1;
+        for (int j = i; order[j] != i; j = order[j])
+        {
+            visited[order[j]] = 1;
+            swaps.push_back(std::make_pair(j, order[j]));
+        }
+    }
+}
+
+// _width̒lzɌ̗݊KpiinverseȂtɓKpČ̏ɖ߂j
+template <typename T>
+void ApplyVertexSwaps(T* data, int width, const std::vector<std::pair<int, int>>& swaps, bool inverse)
+{
+    const int numSwaps = static_cast<int>(swaps.size());
+    for (int k = 0; k < numSwaps; ++k)
+    {
+        const std::pair<int, int>& sw = swaps[inverse ? numSwaps - 1 - k : k];
+        std::swap_ranges(data + static_cast<size_t>(sw.first) * width, data + static_cast<size_t>(sw.first + 1) * width,
+            data + static_cast<size_t>(sw.second) * width);
+    }
+}
+
+// ̓f[^̒_̏ŕבւiSᎦf[^ǂݍݍς݂ł邱Ɓj
+// u݊ɕēւ̂ŁCᎦf[^͍̕Ȃ
+void PermuteInput(Input& input, const std::vector<std::pair<int, int>>& swaps, bool inverse)
+{
+    const size_t numVertices = input.numVertices;
+    const int numExamples = input.numExamples;
+    ApplyVertexSwaps(input.bindModel.data(), 1, swaps, inverse);
+    if (input.temporalRank > 0)
+    {
+        ApplyVertexSwaps(input.sampleCoefficient.data(), input.temporalRank, swaps, inverse);
+    }
+    if (!input.quantizedSample.empty())
+    {
+        for (int s = 0; s < numExamples; ++s)
+        {
+            ApplyVertexSwaps(&input.quantizedSample[s * numVertices * 3], 3, swaps, inverse);
+        }
+        return;
+    }
+    for (int s = 0; s < numExamples; ++s)
+    {
+        ApplyVertexSwaps(&input.sample[s * numVertices], 1, swaps, inverse);
+    }
+}
+
+// o̓f[^̒_̕ϊiinverseȂבւ̏猳̏ցj
+void PermuteOutput(Output& dst, const Output& src, const std::vector<int>& order, const Parameter& param, bool inverse)
+{
+    const int numVertices = static_cast<int>(order.size());
+    const int numIndices = param.numIndices;
+    dst.numBones = src.numBones;
+    dst.numIterations = src.numIterations;
+    dst.boneTrans = src.boneTrans;
+    dst.index.resize(src.index.size());
+    dst.weight.resize(src.weight.size());
+    for (int i = 0; i < numVertices; ++i)
+    {
+        const int from = inverse ? i : order[i];
+        const int to = inverse ? order[i] : i;
+        for (int j = 0; j < numIndices; ++j)
+        {
+            dst.index[to * numIndices + j] = src.index[from * numIndices + j];
+            dst.weight[to * numIndices + j] = src.weight[from * numIndices + j];
+        }
+    }
+}
+
+// Ꭶf[^̋ߎ덷̓aipaletteoutput.boneTrans̍sj
+void ComputeExampleErrorSq(int begin, int end, std::vector<double>& errsq, const Output& output, const Input& input, const Parameter& param, const SkinningPalette& palette)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+    for (int s = begin; s < end; ++s)
+    {
+        double rsqsum = 0;
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const XMVECTOR residual = ComputeResidual(s, v, s * numBones, output, input, numIndices, palette);
+            rsqsum += XMVectorGetX(XMVector3LengthSq(residual));
+        }
+        errsq[s] = rsqsum;
+    }
+}
+
+// SᎦf[^̋ߎ덷̓ai̔rpj
+// palette͕ێĂCω{[p̍ŝݍXV
+double ComputeFittingErrorSq(const Output& output, const Input& input, const Parameter& param, SkinningPalette& palette)
+{
+    palette.Update(output.boneTrans);
+    std::vector<double> errsq(input.numExamples, 0);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numExamples),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ComputeExampleErrorSq(range.begin(), range.end(), errsq, output, input, param, palette);
+    });
+#else
+    ComputeExampleErrorSq(0, input.numExamples, errsq, output, input, param, palette);
+#endif //ENABLE_TBB
+    double rsqsum = 0;
+    for (int s = 0; s < input.numExamples; ++s)
+    {
+        rsqsum += errsq[s];
+    }
+    return rsqsum;
+}
+
+double ComputeFittingErrorSq(const Output& output, const Input& input, const Parameter& param)
+{
+    SkinningPalette palette;
+    return ComputeFittingErrorSq(output, input, param, palette);
+}
+
+double ComputeApproximationErrorSq(const Output& output, const Input& input, const Parameter& param)
+{
+    return ComputeFittingErrorSq(output, input, param);
+}
+
+// {[p̃xNg\Fpɉ]̑ΐi3vfjƕsړi3vfj
+// ΐ\̔Cӂ̓_͐]ɖ߂邽߁C]̂܂܊O}Eł
+void PackBoneParameters(VectorXd& x, const std::vector<RigidTransform>& boneTrans)
+{
+    x.resize(boneTrans.size() * 6);
+    for (size_t i = 0; i < boneTrans.size(); ++i)
+    {
+        XMVECTOR q = XMLoadFloat4A(&boneTrans[i].Rotation());
+        if (XMVectorGetW(q) < 0)
+        {
+            q = XMVectorNegate(q);
+        }
+        // q = (n sin(/2), cos(/2)) -> n /2
+        const double sinHalf = XMVectorGetX(XMVector3Length(q));
+        const double halfAngle = std::atan2(sinHalf, static_cast<double>(XMVectorGetW(q)));
+        const double scale = (sinHalf > 1e-12) ? halfAngle / sinHalf : 1.0;
+        x[i * 6 + 0] = XMVectorGetX(q) * scale;
+        x[i * 6 + 1] = XMVectorGetY(q) * scale;
+        x[i * 6 + 2] = XMVectorGetZ(q) * scale;
+        x[i * 6 + 3] = boneTrans[i].Translation().x;
+        x[i * 6 + 4] = boneTrans[i].Translation().y;
+        x[i * 6 + 5] = boneTrans[i].Translation().z;
+    }
+}
+
+void UnpackBoneParameters(std::vector<RigidTransform>& boneTrans, const VectorXd& x)
+{
+    for (size_t i = 0; i < boneTrans.size(); ++i)
+    {
+        const double halfAngle = std::sqrt(x[i * 6 + 0] * x[i * 6 + 0] + x[i * 6 + 1] * x[i * 6 + 1] + x[i * 6 + 2] * x[i * 6 + 2]);
+        const double scale = (halfAngle > 1e-12) ? std::sin(halfAngle) / halfAngle : 1.0;
+        boneTrans[i].Rotation() = XMFLOAT4A(
+            static_cast<float>(x[i * 6 + 0] * scale),
+            static_cast<float>(x[i * 6 + 1] * scale),
+            static_cast<float>(x[i * 6 + 2] * scale),
+            static_cast<float>(std::cos(halfAngle)));
+        boneTrans[i].Translation() = XMFLOAT3A(
+            static_cast<float>(x[i * 6 + 3]),
+            static_cast<float>(x[i * 6 + 4]),
+            static_cast<float>(x[i * 6 + 5]));
+    }
+}
+
+// BCDs_ x <- G(x) Ƃ݂ȂAnderson
+class AndersonAccelerator
+{
+public:
+    explicit AndersonAccelerator(int numHistory_)
+        : numHistory(numHistory_), numStored(0), next(0)
+    {
+    }
+    // xFÕp[^CgF1񔽕̃p[^ G(x)
+    // O}_ xacc ɕԂiȂfalsej
+    bool Extrapolate(VectorXd& xacc, const VectorXd& x, const VectorXd& g)
+    {
+        const VectorXd f = g - x;
+        if (prevF.size() == f.size())
+        {
+            if (df.rows() != f.size())
+            {
+                df.resize(f.size(), numHistory);
+                dg.resize(g.size(), numHistory);
+            }
+            df.col(next) = f - prevF;
+            dg.col(next) = g - prevG;
+            next = (next + 1) % numHistory;
+            numStored = std::min(numStored + 1, numHistory);
+        }
+        prevF = f;
+        prevG = g;
+        if (numStored == 0)
+        {
+            return false;
+        }
+        //  = argmin |f - F |Cxacc = g - G 
+        const VectorXd gamma = df.leftCols(numStored).colPivHouseholderQr().solve(f);
+        xacc = g - dg.leftCols(numStored) * gamma;
+        return true;
+    }
+    // p[^ςꍇȂǂɗ̂Ă
+    void Reset()
+    {
+        numStored = 0;
+        next = 0;
+        prevF.resize(0);
+    }
+
+private:
+    int numHistory;
+    int numStored;
+    int next;
+    MatrixXd df, dg;
+    VectorXd prevF, prevG;
+};
+
+// {[̍폜Ɠ
+// boneMap[b]Fc{[bgC{[͓C폜{[-1
+// ꂽEFCg͓ɉZC폜ꂽ{[̃EFCg͒_̎c̃EFCgŐK
+// 폜ɉe{[Ȃ_̓EFCg0̂܂܂Ȃ̂ŁCĂяoŃEFCg
+int RemoveBones(Output& output, const std::vector<int>& boneMap, int numExamples, const Parameter& param)
+{
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+    const int numVertices = static_cast<int>(output.index.size() / numIndices);
+
+    std::vector<int> newId(numBones, -1);
+    int numNewBones = 0;
+    for (int b = 0; b < numBones; ++b)
+    {
+        if (boneMap[b] == b)
+        {
+            newId[b] = numNewBones++;
+        }
+    }
+
+    for (int v = 0; v < numVertices; ++v)
+    {
+        int* index = &output.index[v * numIndices];
+        float* weight = &output.weight[v * numIndices];
+        bool dropped = false;
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const int target = (weight[i] != 0) ? boneMap[index[i]] : -1;
+            if (target < 0)
+            {
+                dropped = dropped || (weight[i] != 0);
+                index[i] = 0;
+                weight[i] = 0;
+                continue;
+            }
+            assert(newId[target] >= 0);
+            index[i] = newId[target];
+            for (int j = 0; j < i; ++j)
+            {
+                if (weight[j] != 0 && index[j] == index[i])
+                {
+                    weight[j] += weight[i];
+                    index[i] = 0;
+                    weight[i] = 0;
+                    break;
+                }
+            }
+        }
+        if (dropped)
+        {
+            float wsum = 0;
+            for (int i = 0; i < numIndices; ++i)
+            {
+                wsum += weight[i];
+            }
+            for (int i = 0; i < numIndices && wsum > 0; ++i)
+            {
+                weight[i] /= wsum;
+            }
+        }
+    }
+
+    std::vector<RigidTransform> boneTrans(numExamples * numNewBones);
+    for (int s = 0; s < numExamples; ++s)
+    {
+        for (int b = 0; b < numBones; ++b)
+        {
+            if (newId[b] >= 0)
+            {
+                boneTrans[s * numNewBones + newId[b]] = output.boneTrans[s * numBones + b];
+            }
+        }
+    }
+    output.boneTrans.swap(boneTrans);
+    output.numBones = numNewBones;
+    return numNewBones;
+}
+
+// {[̃EFCgaƁCe钸_E_̕܋
+struct BoneBounds
+{
+    std::vector<double> weight;
+    std::vector<int> numVertices;
+    std::vector<XMFLOAT3A> center;
+    std::vector<float> radius;
+};
+
+void ComputeBoneBounds(BoneBounds& bounds, const Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+
+    bounds.weight.assign(numBones, 0);
+    bounds.numVertices.assign(numBones, 0);
+    bounds.center.assign(numBones, XMFLOAT3A(0, 0, 0));
+    bounds.radius.assign(numBones, 0);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            if (output.weight[v * numIndices + i] != 0)
+            {
+                const int b = output.index[v * numIndices + i];
+                bounds.weight[b] += output.weight[v * numIndices + i];
+                ++bounds.numVertices[b];
+                XMStoreFloat3A(&bounds.center[b], XMLoadFloat3A(&bounds.center[b]) + input.LoadBindModel(v));
+            }
+        }
+    }
+    for (int b = 0; b < numBones; ++b)
+    {
+        if (bounds.numVertices[b] > 0)
+        {
+            XMStoreFloat3A(&bounds.center[b], XMLoadFloat3A(&bounds.center[b]) / static_cast<float>(bounds.numVertices[b]));
+        }
+    }
+    for (int v = 0; v < numVertices; ++v)
+    {
+        for (int i = 0; i < numIndices; ++i)
+        {
+            if (output.weight[v * numIndices + i] != 0)
+            {
+                const int b = output.index[v * numIndices + i];
+                const float d = XMVectorGetX(XMVector3Length(input.LoadBindModel(v) - XMLoadFloat3A(&bounds.center[b])));
+                bounds.radius[b] = std::max(bounds.radius[b], d);
+            }
+        }
+    }
+}
+
+// {[bCc̉e_ɂđSᎦf[^ł |T_b(p) - T_c(p)| ̏
+// {[̕܋܂ދiSmCarj |T_b(m) - T_c(m)| + |R_b - R_c| rC|R_b - R_c| = 2 sin(/2)
+// limit𒴂_őł؂
+float ComputeBoneDeviation(int b, int c, const BoneBounds& bounds, const Output& output, int numExamples, float limit)
+{
+    const int numBones = output.numBones;
+    const XMVECTOR cb = XMLoadFloat3A(&bounds.center[b]);
+    const XMVECTOR cc = XMLoadFloat3A(&bounds.center[c]);
+    const float rb = bounds.radius[b];
+    const float rc = bounds.radius[c];
+    const float d = XMVectorGetX(XMVector3Length(cc - cb));
+    // ̕܋܂ޏꍇ͂̋CłȂΗɐڂ鋅îƂd > 0j
+    XMVECTOR m = cb;
+    float r = rb;
+    if (rc >= d + rb)
+    {
+        m = cc;
+        r = rc;
+    }
+    else if (rb < d + rc)
+    {
+        r = 0.5f * (d + rb + rc);
+        m = cb + (cc - cb) * ((r - rb) / d);
+    }
+    float deviation = 0;
+    for (int s = 0; s < numExamples && deviation <= limit; ++s)
+    {
+        const RigidTransform& tb = output.boneTrans[s * numBones + b];
+        const RigidTransform& tc = output.boneTrans[s * numBones + c];
+        const float cosHalf = std::min(std::abs(XMVectorGetX(XMVector4Dot(XMLoadFloat4A(&tb.Rotation()), XMLoadFloat4A(&tc.Rotation())))), 1.0f);
+        const float chord = 2.0f * std::sqrt(1.0f - cosHalf * cosHalf);
+        const float dist = XMVectorGetX(XMVector3Length(tb.TransformCoord(m) - tc.TransformCoord(m)));
+        deviation = std::max(deviation, dist + chord * r);
+    }
+    return deviation;
+}
+
+// ȅ{[̍폜ƁCSᎦf[^łقړ{[΂̓
+// {[ςꍇtrueԂ
+bool SimplifyBones(Output& output, const Input& input, const Parameter& param)
+{
+    const int numBones = output.numBones;
+
+    BoneBounds bounds;
+    ComputeBoneBounds(bounds, output, input, param);
+
+    std::vector<int> boneMap(numBones);
+    const int heaviestBone = static_cast<int>(std::max_element(bounds.weight.begin(), bounds.weight.end()) - bounds.weight.begin());
+    bool changed = false;
+    for (int b = 0; b < numBones; ++b)
+    {
+        const bool prune = bounds.weight[b] < param.pruneWeightThreshold && b != heaviestBone;
+        boneMap[b] = prune ? -1 : b;
+        changed = changed || prune;
+    }
+
+    if (param.mergeTolerance > 0)
+    {
+        for (int b = 0; b < numBones; ++b)
+        {
+            for (int c = b + 1; c < numBones; ++c)
+            {
+                if (boneMap[b] != b || boneMap[c] != c || bounds.numVertices[b] == 0 || bounds.numVertices[c] == 0)
+                {
+                    continue;
+                }
+                if (ComputeBoneDeviation(b, c, bounds, output, input.numExamples, param.mergeTolerance) <= param.mergeTolerance)
+                {
+                    // ȇ傫{[̎pc
+                    const int keep = (bounds.weight[b] >= bounds.weight[c]) ? b : c;
+                    const int merge = b + c - keep;
+                    boneMap[merge] = keep;
+                    changed = true;
+                }
+            }
+        }
+        // ̃{[łɓꂽꍇ́CŏIIɎc{[܂łǂ
+        for (int b = 0; b < numBones; ++b)
+        {
+            int root = boneMap[b];
+            while (root >= 0 && boneMap[root] != root)
+            {
+                root = boneMap[root];
+            }
+            boneMap[b] = root;
+        }
+    }
+
+    if (changed)
+    {
+        RemoveBones(output, boneMap, input.numExamples, param);
+    }
+    return changed;
+}
+
+// ̋߂{[΂珇ɓC{[numTargetBonesȉɂ
+// e钸_̂Ȃ{[͐ɍ폜
+void MergeBones(Output& output, int numTargetBones, const Input& input, const Parameter& param)
+{
+    while (output.numBones > numTargetBones)
+    {
+        const int numBones = output.numBones;
+        BoneBounds bounds;
+        ComputeBoneBounds(bounds, output, input, param);
+
+        std::vector<int> boneMap(numBones);
+        int numRemoved = 0;
+        for (int b = 0; b < numBones; ++b)
+        {
+            const bool unused = (bounds.numVertices[b] == 0 && numBones - numRemoved > std::max(numTargetBones, 1));
+            boneMap[b] = unused ? -1 : b;
+            numRemoved += unused;
+        }
+
+        std::vector<std::pair<float, std::pair<int, int>>> candidates;
+        for (int b = 0; b < numBones; ++b)
+        {
+            for (int c = b + 1; c < numBones; ++c)
+            {
+                if (boneMap[b] == b && boneMap[c] == c)
+                {
+                    const float deviation = ComputeBoneDeviation(b, c, bounds, output, input.numExamples, std::numeric_limits<float>::max());
+                    candidates.push_back(std::make_pair(deviation, std::make_pair(b, c)));
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        // 1̓ł͊e{[X1񂾂g
+        std::vector<char> used(numBones, 0);
+        for (auto it = candidates.begin(); it != candidates.end() && numBones - numRemoved > numTargetBones; ++it)
+        {
+            const int b = it->second.first;
+            const int c = it->second.second;
+            if (used[b] || used[c])
+            {
+                continue;
+            }
+            const int keep = (bounds.weight[b] >= bounds.weight[c]) ? b : c;
+            boneMap[b + c - keep] = keep;
+            used[b] = used[c] = 1;
+            ++numRemoved;
+        }
+        if (numRemoved == 0)
+        {
+            break;
+        }
+        RemoveBones(output, boneMap, input.numExamples, param);
+    }
+}
+
+// ݂̃{[p̃XLjOEFCgƃ{[p̍œK
+// sBCD̉񐔂Ԃ
+int OptimizeSkinning(Output& output, const Input& input, const Parameter& param)
+{
+    // BCDASYɂXLjOEFCgƃ{[p̌ݍœK
+    AndersonAccelerator accelerator(std::max(param.numAccelerationHistory, 1));
+    VectorXd x, g, xacc;
+    std::vector<RigidTransform> plainTrans;
+    // {[p̍s͔܂ŕێ
+    SkinningPalette palette;
+    BoneVertexIndex boneVertices;
+    const bool checkConvergence = param.convergenceTolerance > 0;
+    // O̔I_̋ߎ덷ivZȂ畉j
+    double errorSq = -1;
+    int loop = 0;
+    while (loop < param.numMaxIterations)
+    {
+        // svȃ{[Cȍ~̃EFCgXVŉ
+        if (loop > 0 && SimplifyBones(output, input, param))
+        {
+            accelerator.Reset();
+            // {[ƌ덷͑̂ŁCr̊ɂȂ
+            errorSq = -1;
+        }
+        if (param.numAccelerationHistory > 0)
+        {
+            PackBoneParameters(x, output.boneTrans);
+        }
+        UpdateWeightMap(output, input, param, loop < param.numBatchedWeightSweeps, palette);
+        if (param.jointBoneUpdate)
+        {
+            UpdateBoneTransformJoint(output, input, param);
+        }
+        else
+        {
+            // EFCg̍XVɃ{[e_ւ̋t蒼
+            BuildBoneVertexIndex(boneVertices, output, input, param);
+            UpdateBoneTransform(output, input, param, boneVertices, palette);
+        }
+        ++loop;
+
+        // O}{[ṕCO̔덷ꍇ̂ݍ̗pCłȂΒʏ̍XVɖ߂
+        // ɂ͒O̔ŋ߂덷ĝŁC덷̌vZ͊O}pꍇ1ōς
+        double nextErrorSq = -1;
+        if (param.numAccelerationHistory > 0)
+        {
+            PackBoneParameters(g, output.boneTrans);
+            if (accelerator.Extrapolate(xacc, x, g) && errorSq >= 0)
+            {
+                plainTrans = output.boneTrans;
+                UnpackBoneParameters(output.boneTrans, xacc);
+                nextErrorSq = ComputeFittingErrorSq(output, input, param, palette);
+                if (!(nextErrorSq < errorSq))
+                {
+                    output.boneTrans.swap(plainTrans);
+                    nextErrorSq = -1;
+                }
+            }
+        }
+        if (param.numAccelerationHistory <= 0 && !checkConvergence)
+        {
+            continue;
+        }
+        if (nextErrorSq < 0)
+        {
+            nextErrorSq = ComputeFittingErrorSq(output, input, param, palette);
+        }
+
+        // 덷̑ΌʂelȂł؂
+        const bool converged = checkConvergence && errorSq > 0
+            && errorSq - nextErrorSq < param.convergenceTolerance * errorSq;
+        errorSq = nextErrorSq;
+        if (converged)
+        {
+            break;
+        }
+    }
+    return loop;
+}
+
+// _͈[begin, end)̑SᎦf[^ł̋ߎ덷̓aipaletteoutput.boneTrans̍sj
+void ComputeVertexErrorSqRange(int begin, int end, std::vector<float>& vertexError, const Output& output, const Input& input, const Parameter& param, const SkinningPalette& palette)
+{
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+    for (int v = begin; v < end; ++v)
+    {
+        double rsqsum = 0;
+        for (int s = 0; s < numExamples; ++s)
+        {
+            const XMVECTOR residual = ComputeResidual(s, v, s * numBones, output, input, numIndices, palette);
+            rsqsum += XMVectorGetX(XMVector3LengthSq(residual));
+        }
+        vertexError[v] = static_cast<float>(rsqsum);
+    }
+}
+
+// _̑SᎦf[^ł̋ߎ덷̓a
+void ComputeVertexErrorSq(std::vector<float>& vertexError, const Output& output, const Input& input, const Parameter& param)
+{
+    vertexError.resize(input.numVertices);
+    SkinningPalette palette;
+    palette.Update(output.boneTrans);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numVertices),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ComputeVertexErrorSqRange(range.begin(), range.end(), vertexError, output, input, param, palette);
+    });
+#else
+    ComputeVertexErrorSqRange(0, input.numVertices, vertexError, output, input, param, palette);
+#endif //ENABLE_TBB
+}
+
+// ڕW덷ł傫NX^1ă{[ǉ
+// 11ǉCĂяočœK̓xɖڕW덷m߂邱ƂŁCڕW𖞂ŏ̃{[Ŏ~܂
+// NX^͒_̎xz{[Ō߁CȂ{[͍œKς݂̎pp
+// ǉ{[ԂiᎦf[^̓ǂݍ݂Ɏsꍇoutputς0Ԃj
+int GrowBones(Output& output, const Input& input, const Parameter& param)
+{
+    const int numVertices = input.numVertices;
+    const int numExamples = input.numExamples;
+    const int numIndices = param.numIndices;
+    const int numBones = output.numBones;
+
+    Output clusters;
+    clusters.numBones = numBones;
+    clusters.index.assign(numVertices * numIndices, 0);
+    clusters.weight.assign(numVertices * numIndices, 0.0f);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const float* weight = &output.weight[v * numIndices];
+        const int i = static_cast<int>(std::max_element(weight, weight + numIndices) - weight);
+        clusters.index[v * numIndices + 0] = output.index[v * numIndices + i];
+        clusters.weight[v * numIndices + 0] = 1.0f;
+    }
+
+    // 덷̒_̋eʂɑ΂钴ߕő̃NX^𕪊
+    std::vector<float> vertexError;
+    ComputeVertexErrorSq(vertexError, output, input, param);
+    std::vector<double> excess(numBones, 0);
+    const double vertexBudget = static_cast<double>(param.targetRmsError) * param.targetRmsError * numExamples;
+    for (int v = 0; v < numVertices; ++v)
+    {
+        excess[clusters.index[v * numIndices + 0]] += vertexError[v] - vertexBudget;
+    }
+    const int worst = static_cast<int>(std::max_element(excess.begin(), excess.end()) - excess.begin());
+    if (numBones >= param.numMaxBones || !(excess[worst] > 0))
+    {
+        return 0;
+    }
+    std::vector<char> split(numBones, 0);
+    split[worst] = 1;
+
+    const std::vector<int> parentIndex(clusters.index);
+    const int numClusters = SplitClusters(clusters, numBones, split, vertexError, input, param, nullptr);
+    if (numClusters == numBones)
+    {
+        return 0;
+    }
+    std::vector<int> parent(numClusters);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        parent[clusters.index[v * numIndices + 0]] = parentIndex[v * numIndices + 0];
+    }
+
+    // NX^̒_eƎq̂덷̏ɐU蕪Cp𓖂Ă͂ߒ
+    std::vector<RigidTransform> hardTrans(numExamples * numClusters);
+    if (!UpdateBoneTransform(hardTrans, numClusters, clusters, input, param))
+    {
+        return 0;
+    }
+    SkinningPalette palette;
+    palette.Update(hardTrans);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const int c = parentIndex[v * numIndices + 0];
+        if (!split[c] || clusters.index[v * numIndices + 0] >= numBones)
+        {
+            continue;
+        }
+        int bestBone = c;
+        float minErr = std::numeric_limits<float>::max();
+        for (int b = 0; b < numClusters; ++b)
+        {
+            if (b != c && (b < numBones || parent[b] != c))
+            {
+                continue;
+            }
+            float errsq = 0;
+            for (int s = 0; s < numExamples; ++s)
+            {
+                XMVECTOR diff = input.LoadSample(s, v)
+                    - palette.TransformCoord(s * numClusters + b, input.LoadBindModel(v));
+                errsq += XMVectorGetX(XMVector3LengthSq(diff));
+            }
+            if (errsq < minErr)
+            {
+                bestBone = b;
+                minErr = errsq;
+            }
+        }
+        clusters.index[v * numIndices + 0] = bestBone;
+    }
+    if (!UpdateBoneTransform(hardTrans, numClusters, clusters, input, param))
+    {
+        return 0;
+    }
+
+    std::vector<RigidTransform> boneTrans(numExamples * numClusters);
+    for (int s = 0; s < numExamples; ++s)
+    {
+        for (int b = 0; b < numClusters; ++b)
+        {
+            const bool refit = (b >= numBones) || split[b];
+            boneTrans[s * numClusters + b] = refit ? hardTrans[s * numClusters + b] : output.boneTrans[s * numBones + b];
+        }
+    }
+    // EFCg͑œK̍ŏɉ
+    output.boneTrans.swap(boneTrans);
+    output.numBones = numClusters;
+    return numClusters - numBones;
+}
 
-    VectorXd weight = VectorXd::Zero(numVertices);
-    std::vector<XMFLOAT3A> model(input.numVertices), example(input.numVertices);
-    for (int bone = 0; bone < numBones; ++bone)
+// [begin, end)̏NX^OƒZœK
+// 0͌IȕCȊO͌█̗ŕ̎I
+// Ꭶf[^̓ǂݍ݂Ɏs̓{[0ɂ
+void RefineStartCandidates(int begin, int end, std::vector<Output>& candidates, std::vector<double>& errorSq,
+    const Output& start, const std::vector<RigidTransform>& startTrans, const Input& input, const Parameter& param)
+{
+    Parameter refineParam = param;
+    refineParam.numMaxIterations = param.numStartIterations;
+    for (int k = begin; k < end; ++k)
     {
-        for (int v = 0; v < numVertices; ++v)
+        Output& candidate = candidates[k];
+        candidate = start;
+        std::vector<RigidTransform> boneTrans(startTrans);
+        std::mt19937 random(k);
+        candidate.numBones = ClusterBones(candidate, boneTrans, 1, input, param, (k == 0) ? nullptr : &random);
+        if (candidate.numBones == 0)
         {
-            weight[v] = 0;
-            for (int i = 0; i < numIndices; ++i)
-            {
-                if (output.index[v * numIndices + i] == bone)
-                {
-                    weight[v] = output.weight[v * numIndices + i];
-                    break;
-                }
-            }
+            continue;
         }
 
-        for (int s = 0; s < numExamples; ++s)
+        candidate.boneTrans.assign(input.numExamples * candidate.numBones, RigidTransform::Identity());
+        if (!UpdateBoneTransform(candidate.boneTrans, candidate.numBones, candidate, input, param))
         {
-            // xxx.9F\tilde{q}_{j,n}
-            ComputeExamplePoints(example, s, bone, output, input, param);
-            // xxx.10Cxxx.11
-            XMFLOAT3A corModel(0, 0, 0), corExample(0, 0, 0);
-            SubtractCentroid(model, example, corModel, corExample, weight, output, input);
-            // xxx.12̉
-            RigidTransform transform = CalcPointsAlignment(model.size(), model.begin(), example.begin());
-            // xxx.13
-            XMVECTOR d = XMLoadFloat3A(&corExample) - transform.TransformCoord(XMLoadFloat3A(&corModel));
-            XMStoreFloat3A(&transform.Translation(), d + XMLoadFloat3A(&transform.Translation()));
-            output.boneTrans[s * output.numBones + bone] = transform;
+            candidate.numBones = 0;
+            continue;
         }
+        OptimizeSkinning(candidate, input, refineParam);
+        errorSq[k] = ComputeFittingErrorSq(candidate, input, param);
     }
 }
-#endif
-void UpdateBoneTransform(std::vector<RigidTransform>& boneTrans, int numBones, const Output& output, const Input& input, const Parameter& param)
+
+// ̏NX^OɎCZœǨŌ덷ŏ̂̂I
+// outputɂ͑I΂ꂽ̃EFCgƃ{[pCœK͂p
+// Ꭶf[^̓ǂݍ݂Ɏsꍇ0Ԃ
+int ClusterInitialBonesMultiStart(Output& output, const Input& input, const Parameter& param)
 {
-    const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
+    const int numStarts = param.numClusteringStarts;
 
-    std::vector<int> numBoneVertices(numBones, 0);
-    for (int v = 0; v < numVertices; ++v)
+    // 1NX^̓Ă͂߂͑SŋʂȂ̂ŁCᎦf[^̓҂Ȃxs
+    std::vector<RigidTransform> startTrans;
+    if (!BindToSingleCluster(output, startTrans, input, param))
     {
-        ++numBoneVertices[output.index[v * numIndices + 0]];
+        return 0;
     }
-    std::vector<int> boneVertexId(numBones, 0);
-    for (int i = 1; i < numBones; ++i)
+
+    std::vector<Output> candidates(numStarts);
+    std::vector<double> errorSq(numStarts, std::numeric_limits<double>::max());
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numStarts, 1),
+        [&](const tbb::blocked_range<int>& range)
     {
-        boneVertexId[i] = boneVertexId[i - 1] + numBoneVertices[i - 1];
-    }
-    std::vector<XMFLOAT3A> skin(numVertices, XMFLOAT3A(0, 0, 0));
-    std::vector<XMFLOAT3A> anim(numVertices * numExamples, XMFLOAT3A(0, 0, 0));
-    for (int v = 0; v < numVertices; ++v)
+        RefineStartCandidates(range.begin(), range.end(), candidates, errorSq, output, startTrans, input, param);
+    });
+#else
+    RefineStartCandidates(0, numStarts, candidates, errorSq, output, startTrans, input, param);
+#endif //ENABLE_TBB
+
+    for (int k = 0; k < numStarts; ++k)
     {
-        const int bs = output.index[v * numIndices + 0];
-        const int bd = boneVertexId[bs];
-        skin[bd] = input.bindModel[v];
-        for (int s = 0; s < numExamples; ++s)
+        if (candidates[k].numBones == 0)
         {
-            anim[s * numVertices + bd] = input.sample[s * numVertices + v];
+            return 0;
         }
-        ++boneVertexId[bs];
     }
-    boneVertexId[0] = 0;
-    for (int i = 1; i < numBones; ++i)
+    const int best = static_cast<int>(std::min_element(errorSq.begin(), errorSq.end()) - errorSq.begin());
+    output = candidates[best];
+    return output.numBones;
+}
+
+// oCfBOiꍇoutputɒZœǨʂj
+// Ꭶf[^̓ǂݍ݂Ɏsꍇ0Ԃ
+int InitializeBones(Output& output, const Input& input, const Parameter& param)
+{
+    output.boneTrans.clear();
+    if (param.numClusteringStarts > 1)
     {
-        boneVertexId[i] = boneVertexId[i - 1] + numBoneVertices[i - 1];
+        return ClusterInitialBonesMultiStart(output, input, param);
     }
-    for (int b = 0; b < numBones; ++b)
+    return ClusterInitialBones(output, input, param);
+}
+
+// {[̍œKƁCڕW덷ɒB܂ł̃{[̒ǉ
+void SolveSkinning(Output& output, const Input& input, const Parameter& param)
+{
+    // {[gXtH[ioCfBOŋ܂ĂȂ΃NX^ɓĂ͂߂j
+    if (output.boneTrans.empty())
     {
-        for (int s = 0; s < numExamples; ++s)
+        output.boneTrans.assign(input.numExamples * output.numBones, RigidTransform::Identity());
+        UpdateBoneTransform(output.boneTrans, output.numBones, output, input, param);
+    }
+    output.numIterations = OptimizeSkinning(output, input, param);
+    if (param.targetRmsError <= 0)
+    {
+        return;
+    }
+
+    // {[1ǉCỎpčœKCǉOɖڕW덷m߂
+    const double targetErrorSq = static_cast<double>(param.targetRmsError) * param.targetRmsError * input.numVertices * input.numExamples;
+    while (output.numBones < param.numMaxBones && ComputeFittingErrorSq(output, input, param) > targetErrorSq)
+    {
+        const int numPrevBones = output.numBones;
+        if (GrowBones(output, input, param) == 0)
         {
-            boneTrans[s * numBones + b] = CalcPointsAlignment(numBoneVertices[b], skin.begin() + boneVertexId[b], anim.begin() + s * numVertices + boneVertexId[b]);
+            break;
+        }
+        output.numIterations += OptimizeSkinning(output, input, param);
+        if (output.numBones <= numPrevBones)
+        {
+            // ǉ{[E폜ꂽ
+            break;
         }
     }
 }
 
-int BindVertexToBone(Output& output, std::vector<RigidTransform>& boneTrans, const Input& input, const Parameter& param)
+#pragma region Decompose
+double Decompose(Output& output, Input& input, const Parameter& param)
 {
     const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
     const int numIndices = param.numIndices;
-    int numBones = static_cast<int>(boneTrans.size() / numExamples);
 
-    std::vector<int> numBoneVertices(numBones, 0);
-    std::vector<float> vertexError(numVertices, 0);
+    output.index.assign(numVertices * numIndices, 0);
+    output.weight.assign(numVertices * numIndices, 0.0f);
 
-    for (int v = 0; v < numVertices; ++v)
+    // NX^Ғlő剻@poCfBO
+    output.numBones = InitializeBones(output, input, param);
+    if (output.numBones == 0)
     {
-        int bestBone = 0;
-        float minErr = std::numeric_limits<float>::max();
-        const XMVECTOR bindModelPos = XMLoadFloat3A(&input.bindModel[v]);
-        for (int b = 0; b < numBones; ++b)
+        return -1.0;
+    }
+
+    if (param.reorderVertices)
+    {
+        // {[ɑ钸_A悤בւčœKC͂ƌʂ̒_ɖ߂
+        std::vector<int> order;
+        ComputeVertexOrder(order, output, input, param);
+        std::vector<std::pair<int, int>> swaps;
+        ComputeVertexSwaps(swaps, order);
+        PermuteInput(input, swaps, false);
+        Output sortedOutput;
+        PermuteOutput(sortedOutput, output, order, param, false);
+        SolveSkinning(sortedOutput, input, param);
+        PermuteInput(input, swaps, true);
+        PermuteOutput(output, sortedOutput, order, param, true);
+    }
+    else
+    {
+        SolveSkinning(output, input, param);
+    }
+    return ComputeFittingErrorSq(output, input, param);
+}
+
+// ڍדx̃{[܂œȂCȌڍדx̉œK
+void SolveLevels(std::vector<Output>& levels, Output& output, const Input& input, const Parameter& param, const std::vector<int>& levelBones)
+{
+    SolveSkinning(output, input, param);
+    Parameter refitParam = param;
+    refitParam.numMaxIterations = param.numLevelIterations;
+    for (size_t l = 0; l < levelBones.size(); ++l)
+    {
+        if (output.numBones > levelBones[l])
         {
-            float errsq = 0;
-            for (int s = 0; s < numExamples; ++s)
-            {
-                const RigidTransform& at = boneTrans[s * numBones + b];
-                XMVECTOR diff = XMLoadFloat3A(&input.sample[s * numVertices + v])
-                              - at.TransformCoord(XMLoadFloat3A(&input.bindModel[v]));
-                errsq += XMVectorGetX(XMVector3LengthSq(diff));
-            }
-            if (errsq < minErr)
-            {
-                bestBone = b;
-                minErr = errsq;
-            }
+            MergeBones(output, levelBones[l], input, param);
+            output.numIterations += OptimizeSkinning(output, input, refitParam);
         }
-        ++numBoneVertices[bestBone];
-        output.index[v * numIndices + 0] = bestBone;
-        vertexError[v] = minErr;
+        levels.push_back(output);
     }
+}
 
-    // NX^̏
-    std::vector<int>::iterator smallestBoneSize = std::min_element(numBoneVertices.begin(), numBoneVertices.end());
-    while (*smallestBoneSize <= 0)
+void DecomposeLevels(std::vector<Output>& levels, std::vector<double>& errorSq, Input& input, const Parameter& param, const std::vector<int>& levelBones)
+{
+    const int numVertices = input.numVertices;
+    const int numIndices = param.numIndices;
+
+    levels.clear();
+    errorSq.clear();
+    if (levelBones.empty())
     {
-        const int smallestBone = static_cast<int>(smallestBoneSize - numBoneVertices.begin());
-        numBoneVertices.erase(numBoneVertices.begin() + smallestBone);
-        for (int s = input.numExamples - 1; s >= 0; --s)
+        return;
+    }
+
+    // łڍׂȏڍדx̃{[ŃNX^OC{[̒ǉ͍sȂ
+    Parameter levelParam = param;
+    levelParam.numMinBones = levelBones.front();
+    levelParam.targetRmsError = 0;
+
+    Output output;
+    output.index.assign(numVertices * numIndices, 0);
+    output.weight.assign(numVertices * numIndices, 0.0f);
+    output.numBones = InitializeBones(output, input, levelParam);
+    if (output.numBones == 0)
+    {
+        return;
+    }
+
+    if (param.reorderVertices)
+    {
+        std::vector<int> order;
+        ComputeVertexOrder(order, output, input, levelParam);
+        std::vector<std::pair<int, int>> swaps;
+        ComputeVertexSwaps(swaps, order);
+        PermuteInput(input, swaps, false);
+        Output sortedOutput;
+        PermuteOutput(sortedOutput, output, order, levelParam, false);
+        std::vector<Output> sortedLevels;
+        SolveLevels(sortedLevels, sortedOutput, input, levelParam, levelBones);
+        PermuteInput(input, swaps, true);
+        levels.resize(sortedLevels.size());
+        for (size_t l = 0; l < sortedLevels.size(); ++l)
         {
-            boneTrans.erase(boneTrans.begin() + s * numBones + smallestBone);
+            PermuteOutput(levels[l], sortedLevels[l], order, levelParam, true);
         }
+    }
+    else
+    {
+        SolveLevels(levels, output, input, levelParam, levelBones);
+    }
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        errorSq.push_back(ComputeFittingErrorSq(levels[l], input, param));
+    }
+}
+#pragma endregion
+
+#pragma region TemporalBasis
+// Ꭶf[^s XiᎦf[^ x 3_CX_s,3v+d = _v̍WdjƂ݂ȂC
+// Ꭶf[^͈[begin, end)ɂ y_s = _j X_sj z_j ߂
+void MultiplyExamplesRange(int begin, int end, MatrixXd& y, const MatrixXd& z, const Input& input)
+{
+    const int numVertices = input.numVertices;
+    for (int s = begin; s < end; ++s)
+    {
+        y.row(s).setZero();
         for (int v = 0; v < numVertices; ++v)
         {
-            int b = output.index[v * numIndices + 0];
-            if (b >= smallestBone)
-            {
-                --output.index[v * numIndices + 0];
-            }
+            XMFLOAT3 q;
+            XMStoreFloat3(&q, input.LoadSample(s, v));
+            y.row(s) += q.x * z.row(v * 3 + 0) + q.y * z.row(v * 3 + 1) + q.z * z.row(v * 3 + 2);
         }
-        --numBones;
-        smallestBoneSize = std::min_element(numBoneVertices.begin(), numBoneVertices.end());
     }
-    return static_cast<int>(numBoneVertices.size());
 }
 
-int ClusterInitialBones(Output& output, const Input& input, const Parameter& param)
+// _͈[begin, end)ɂ z_j = _s X_sj y_s ߂
+void MultiplyExamplesTransposedRange(int begin, int end, MatrixXd& z, const MatrixXd& y, const Input& input)
+{
+    for (int v = begin; v < end; ++v)
+    {
+        z.middleRows(v * 3, 3).setZero();
+        for (int s = 0; s < input.numExamples; ++s)
+        {
+            XMFLOAT3 q;
+            XMStoreFloat3(&q, input.LoadSample(s, v));
+            z.row(v * 3 + 0) += q.x * y.row(s);
+            z.row(v * 3 + 1) += q.y * y.row(s);
+            z.row(v * 3 + 2) += q.z * y.row(s);
+        }
+    }
+}
+
+// y = X z
+void MultiplyExamples(MatrixXd& y, const MatrixXd& z, const Input& input)
+{
+    y.resize(input.numExamples, z.cols());
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numExamples),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        MultiplyExamplesRange(range.begin(), range.end(), y, z, input);
+    });
+#else
+    MultiplyExamplesRange(0, input.numExamples, y, z, input);
+#endif //ENABLE_TBB
+}
+
+// z = X^T y
+void MultiplyExamplesTransposed(MatrixXd& z, const MatrixXd& y, const Input& input)
+{
+    z.resize(input.numVertices * 3, y.cols());
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, input.numVertices),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        MultiplyExamplesTransposedRange(range.begin(), range.end(), z, y, input);
+    });
+#else
+    MultiplyExamplesTransposedRange(0, input.numVertices, z, y, input);
+#endif //ENABLE_TBB
+}
+
+// ̐K
+void Orthonormalize(MatrixXd& m)
+{
+    const HouseholderQR<MatrixXd> qr(m);
+    m = qr.householderQ() * MatrixXd::Identity(m.rows(), m.cols());
+}
+
+// 񖈂ɗᎦf[^Ԃ̕ςiԕςᎦf[^ X_c = X - 1 ^T ɑ΂ y = X_c zj
+void CenterExampleColumns(MatrixXd& y)
+{
+    y.rowwise() -= y.colwise().mean();
+}
+
+double ComputeTemporalBasis(Input& input, double energyRatio)
 {
     const int numVertices = input.numVertices;
     const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
 
-    std::fill(output.index.begin(), output.index.end(), 0);
-    std::fill(output.weight.begin(), output.weight.end(), 0.0f);
-    for (int v = 0; v < numVertices; ++v)
+    // _OՂ̎ԕ  ƁCςᎦf[^̓a |X_c|^2 = |X|^2 - S ||^2
+    VectorXd mean = VectorXd::Zero(numVertices * 3);
+    double totalEnergy = 0;
+    for (int s = 0; s < numExamples; ++s)
     {
-        output.weight[v * numIndices + 0] = 1.0f;
+        if (!input.WaitExample(s))
+        {
+            return -1.0;
+        }
+        for (int v = 0; v < numVertices; ++v)
+        {
+            XMFLOAT3 q;
+            XMStoreFloat3(&q, input.LoadSample(s, v));
+            mean[v * 3 + 0] += q.x;
+            mean[v * 3 + 1] += q.y;
+            mean[v * 3 + 2] += q.z;
+            totalEnergy += static_cast<double>(q.x) * q.x + static_cast<double>(q.y) * q.y + static_cast<double>(q.z) * q.z;
+        }
     }
+    if (numExamples > 0)
+    {
+        mean /= numExamples;
+    }
+    totalEnergy = std::max(totalEnergy - numExamples * mean.squaredNorm(), 0.0);
 
-    int numClusters = 1;
-    std::vector<RigidTransform> boneTrans(numExamples);
-    UpdateBoneTransform(boneTrans, numClusters, output, input, param);
-
-    while (numClusters < param.numMinBones)
+    // SVDF_ˉe X_c ̒lߎCׂ攽1sĂ
+    // ȌŗLl (X_c^T Q)^T (X_c^T Q) = W  W^T iكxNg Q WCْl̓ j
+    // Q ̗ 1 ɒ̂ X_c^T Q = X^T Q
+    // ^ȂΎˉe̎{ɂĂ蒼
+    std::mt19937 random(numExamples);
+    std::normal_distribution<double> gaussian;
+    MatrixXd y, z, basis, coefficient;
+    VectorXd energy;
+    // ԕς̊ƍ킹ėᎦf[^𒴂Ȃ悤ɂ
+    const int maxSketches = std::max(numExamples - 1, 1);
+    int numSketches = std::min(maxSketches, 16);
+    int rank = 0;
+    for (;;)
     {
-        std::vector<XMFLOAT3A> clusterCenter(numClusters, XMFLOAT3A(0, 0, 0));
-        std::vector<int> numBoneVertices(numClusters, 0);
-        for (int v = 0; v < numVertices; ++v)
+        MatrixXd omega(numVertices * 3, numSketches);
+        for (int i = 0; i < omega.size(); ++i)
         {
-            const int c = output.index[v * numIndices + 0];
-            clusterCenter[c].x += input.bindModel[v].x;
-            clusterCenter[c].y += input.bindModel[v].y;
-            clusterCenter[c].z += input.bindModel[v].z;
-            ++numBoneVertices[c];
+            omega.data()[i] = gaussian(random);
         }
-        for (int c = 0; c < numClusters; ++c)
+        MultiplyExamples(y, omega, input);
+        CenterExampleColumns(y);
+        Orthonormalize(y);
+        MultiplyExamplesTransposed(z, y, input);
+        MultiplyExamples(y, z, input);
+        CenterExampleColumns(y);
+        Orthonormalize(y);
+        MultiplyExamplesTransposed(z, y, input);
+
+        const SelfAdjointEigenSolver<MatrixXd> eigen(z.transpose() * z);
+        // ŗLl͏Ȃ̂ŋtɕׂ
+        energy = eigen.eigenvalues().reverse();
+        const MatrixXd w = eigen.eigenvectors().rowwise().reverse();
+        double captured = 0;
+        for (rank = 0; rank < numSketches && captured < energyRatio * totalEnergy; ++rank)
+        {
+            captured += energy[rank];
+        }
+        if (captured >= energyRatio * totalEnergy || numSketches == maxSketches)
         {
-            clusterCenter[c].x /= static_cast<float>(numBoneVertices[c]);
-            clusterCenter[c].y /= static_cast<float>(numBoneVertices[c]);
-            clusterCenter[c].z /= static_cast<float>(numBoneVertices[c]);
+            basis = y * w.leftCols(rank);
+            coefficient = z * w.leftCols(rank);
+            break;
         }
+        numSketches = std::min(maxSketches, numSketches * 2);
+    }
 
-        std::vector<float> maxClusterError(numClusters, -std::numeric_limits<float>::max());
-        std::vector<int> mostDistantVertex(numClusters, -1);
-        for (int v = 0; v < numVertices; ++v)
+    // 擪̊͒萔xNg 1/SiW S ʁjƂĎԕς̂܂ܕ\
+    const int numBasis = rank + 1;
+    const double invSqrtExamples = (numExamples > 0) ? 1.0 / std::sqrt(static_cast<double>(numExamples)) : 0.0;
+    input.temporalRank = numBasis;
+    input.temporalBasis.resize(numExamples * numBasis);
+    for (int s = 0; s < numExamples; ++s)
+    {
+        input.temporalBasis[s * numBasis + 0] = invSqrtExamples;
+        for (int k = 0; k < rank; ++k)
         {
-            const int c = output.index[v * numIndices + 0];
-            float sumApproxErrorSq = 0;
-            for (int s = 0; s < numExamples; ++s)
-            {
-                XMVECTOR diff = XMLoadFloat3A(&input.sample[s * numVertices + v])
-                    - boneTrans[s * numClusters + c].TransformCoord(XMLoadFloat3A(&input.bindModel[v]));
-                sumApproxErrorSq += XMVectorGetX(XMVector3LengthSq(diff));
-            }
-            XMVECTOR d = XMLoadFloat3A(&input.bindModel[v]) - XMLoadFloat3A(&clusterCenter[c]);
-            float errSq = sumApproxErrorSq * XMVectorGetX(XMVector3LengthSq(d));
-            if (errSq > maxClusterError[c])
-            {
-                maxClusterError[c] = errSq;
-                mostDistantVertex[c] = v;
-            }
+            input.temporalBasis[s * numBasis + k + 1] = basis(s, k);
         }
-        int numPrevClusters = numClusters;
-        for (int c = 0; c < numPrevClusters; ++c)
+    }
+    input.sampleCoefficient.resize(numVertices * numBasis);
+    for (int v = 0; v < numVertices; ++v)
+    {
+        const double scale = numExamples * invSqrtExamples;
+        input.sampleCoefficient[v * numBasis + 0] = XMFLOAT3(static_cast<float>(mean[v * 3 + 0] * scale),
+            static_cast<float>(mean[v * 3 + 1] * scale), static_cast<float>(mean[v * 3 + 2] * scale));
+        for (int k = 0; k < rank; ++k)
         {
-            output.index[mostDistantVertex[c] * numIndices + 0] = numClusters++;
-            --numBoneVertices[c];
-            numBoneVertices.push_back(1);
+            input.sampleCoefficient[v * numBasis + k + 1] = XMFLOAT3(static_cast<float>(coefficient(v * 3 + 0, k)),
+                static_cast<float>(coefficient(v * 3 + 1, k)), static_cast<float>(coefficient(v * 3 + 2, k)));
         }
-        boneTrans.resize(numExamples * numClusters);
+    }
+    // ˉe덷 |X - U U^T X|^2 = |X_c|^2 - _k _k  |X_c|^2 ɑ΂
+    if (totalEnergy <= 0)
+    {
+        return 0.0;
+    }
+    return std::max(totalEnergy - energy.head(rank).sum(), 0.0) / totalEnergy;
+}
+#pragma endregion
 
-        UpdateBoneTransform(boneTrans, numClusters, output, input, param);
-        numClusters = BindVertexToBone(output, boneTrans, input, param);
+#pragma region SampleQuantization
+// Ꭶf[^͈[begin, end)̃oCh_W̕ψʂ͈̔
+void ComputeSampleDeltaBoundsRange(int begin, int end, std::vector<XMFLOAT3>& minDelta, std::vector<XMFLOAT3>& maxDelta, const Input& input)
+{
+    for (int s = begin; s < end; ++s)
+    {
+        XMVECTOR lower = XMVectorReplicate(std::numeric_limits<float>::max());
+        XMVECTOR upper = XMVectorReplicate(-std::numeric_limits<float>::max());
+        for (int v = 0; v < input.numVertices; ++v)
+        {
+            const XMVECTOR delta = input.LoadSample(s, v) - input.LoadBindModel(v);
+            lower = XMVectorMin(lower, delta);
+            upper = XMVectorMax(upper, delta);
+        }
+        XMStoreFloat3(&minDelta[s], lower);
+        XMStoreFloat3(&maxDelta[s], upper);
     }
-    return numClusters;
 }
 
-#pragma region Decompose
-double Decompose(Output& output, const Input& input, const Parameter& param)
+// Ꭶf[^͈[begin, end)̕ψʂʎqCᎦf[^̗ʎq덷̓aƍől߂
+void QuantizeSamplesRange(int begin, int end, std::vector<unsigned short>& quantized, std::vector<double>& errorSq, std::vector<double>& maxErrorSq,
+    const Input& input, FXMVECTOR deltaMin, FXMVECTOR deltaStep)
 {
     const int numVertices = input.numVertices;
-    const int numExamples = input.numExamples;
-    const int numIndices = param.numIndices;
+    // ψʂ͍̎ݕ0Ȃ̂ŗʎql0Ƃ
+    const XMVECTOR invStep = XMVectorSelect(XMVectorZero(), XMVectorReciprocal(deltaStep), XMVectorGreater(deltaStep, XMVectorZero()));
+    const XMVECTOR maxValue = XMVectorReplicate(65535.0f);
+    for (int s = begin; s < end; ++s)
+    {
+        errorSq[s] = 0;
+        maxErrorSq[s] = 0;
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const XMVECTOR p = input.LoadSample(s, v);
+            const XMVECTOR level = XMVectorClamp(XMVectorRound((p - input.LoadBindModel(v) - deltaMin) * invStep), XMVectorZero(), maxValue);
+            XMFLOAT3 q;
+            XMStoreFloat3(&q, level);
+            unsigned short* dst = &quantized[(static_cast<size_t>(s) * numVertices + v) * 3];
+            dst[0] = static_cast<unsigned short>(q.x);
+            dst[1] = static_cast<unsigned short>(q.y);
+            dst[2] = static_cast<unsigned short>(q.z);
+            const XMVECTOR decoded = input.LoadBindModel(v) + XMVectorMultiplyAdd(level, deltaStep, deltaMin);
+            const double e = XMVectorGetX(XMVector3LengthSq(decoded - p));
+            errorSq[s] += e;
+            maxErrorSq[s] = std::max(maxErrorSq[s], e);
+        }
+    }
+}
 
-    output.index.assign(numVertices * numIndices, 0);
-    output.weight.assign(numVertices * numIndices, 0.0f);
+double QuantizeSamples(Input& input, double* maxError)
+{
+    const int numExamples = input.numExamples;
+    for (int s = 0; s < numExamples; ++s)
+    {
+        if (!input.WaitExample(s))
+        {
+            return -1.0;
+        }
+    }
+    std::vector<XMFLOAT3> minDelta(numExamples), maxDelta(numExamples);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numExamples),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ComputeSampleDeltaBoundsRange(range.begin(), range.end(), minDelta, maxDelta, input);
+    });
+#else
+    ComputeSampleDeltaBoundsRange(0, numExamples, minDelta, maxDelta, input);
+#endif //ENABLE_TBB
+    XMVECTOR lower = XMVectorReplicate(std::numeric_limits<float>::max());
+    XMVECTOR upper = XMVectorReplicate(-std::numeric_limits<float>::max());
+    for (int s = 0; s < numExamples; ++s)
+    {
+        lower = XMVectorMin(lower, XMLoadFloat3(&minDelta[s]));
+        upper = XMVectorMax(upper, XMLoadFloat3(&maxDelta[s]));
+    }
+    if (numExamples == 0)
+    {
+        lower = upper = XMVectorZero();
+    }
+    const XMVECTOR step = (upper - lower) / 65535.0f;
 
-    // NX^Ғlő剻@poCfBO
-    output.numBones = ClusterInitialBones(output, input, param);
-    // {[gXtH[
-    output.boneTrans.assign(numExamples * output.numBones, RigidTransform::Identity());
-    UpdateBoneTransform(output.boneTrans, output.numBones, output, input, param);
+    std::vector<unsigned short> quantized(static_cast<size_t>(numExamples) * input.numVertices * 3);
+    std::vector<double> errorSq(numExamples), maxErrorSq(numExamples);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numExamples),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        QuantizeSamplesRange(range.begin(), range.end(), quantized, errorSq, maxErrorSq, input, lower, step);
+    });
+#else
+    QuantizeSamplesRange(0, numExamples, quantized, errorSq, maxErrorSq, input, lower, step);
+#endif //ENABLE_TBB
 
-    // BCDASYɂXLjOEFCgƃ{[p̌ݍœK
-    for (int loop = 0; loop < param.numMaxIterations; ++loop)
+    input.quantizedSample.swap(quantized);
+    XMStoreFloat3(&input.sampleDeltaMin, lower);
+    XMStoreFloat3(&input.sampleDeltaStep, step);
+    std::vector<XMFLOAT3>().swap(input.sample);
+    input.waitExample = nullptr;
+    double totalErrorSq = 0, totalMaxErrorSq = 0;
+    for (int s = 0; s < numExamples; ++s)
+    {
+        totalErrorSq += errorSq[s];
+        totalMaxErrorSq = std::max(totalMaxErrorSq, maxErrorSq[s]);
+    }
+    if (maxError != nullptr)
     {
-        UpdateWeightMap(output, input, param);
-        UpdateBoneTransform(output, input, param);
+        *maxError = std::sqrt(totalMaxErrorSq);
     }
-    return ComputeApproximationErrorSq(output, input, param);
+    return totalErrorSq;
 }
 #pragma endregion
 
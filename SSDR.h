@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include <DirectXMath.h>
 #include "RigidTransform.h"
 
@@ -13,13 +14,51 @@ namespace SSDR
         int numVertices;
         //! Ꭶf[^
         int numExamples;
-        //! oCh_Wi_j
-        std::vector<DirectX::XMFLOAT3A> bindModel;
-        //! Ꭶ`󒸓_W (Ꭶf[^ x _j
-        std::vector<DirectX::XMFLOAT3A> sample;
+        //! oCh_Wi_C12oCgPʂŋl߂Ċi[j
+        std::vector<DirectX::XMFLOAT3> bindModel;
+        //! Ꭶ`󒸓_W (Ꭶf[^ x _C12oCgPʂŋl߂Ċi[j
+        std::vector<DirectX::XMFLOAT3> sample;
+        //! Ꭶf[^̓҂iݒȂSᎦf[^ǂݍݍς݂Ƃ݂Ȃj
+        //! NX^ǑɎꍇ͕̃XbhĂ΂
+        //! ǂݍ݂ɎsꍇfalseԂCvZ𒆒f
+        std::function<bool(int)> waitExample;
+        //! ԕ̊̎i0Ȃ疢gpCComputeTemporalBasisŐݒ肳j
+        int temporalRank;
+        //! ԕ̐KiᎦf[^ x j
+        std::vector<double> temporalBasis;
+        //! Ꭶ`󒸓_W̊ɂWi_ x j
+        std::vector<DirectX::XMFLOAT3> sampleCoefficient;
+        //! oCh_W̕ψʂ16rbgɗʎqᎦ`iᎦf[^ x _ x 3CȂsamplegj
+        //! QuantizeSamplesŐݒ肳Csample͉
+        std::vector<unsigned short> quantizedSample;
+        //! ʎqψʂ̍ŏliNbvŚCj
+        DirectX::XMFLOAT3 sampleDeltaMin;
+        //! ʎqψʂ̍ݕiNbvŚCj
+        DirectX::XMFLOAT3 sampleDeltaStep;
 
-        Input() : numVertices(0), numExamples(0) {}
+        Input() : numVertices(0), numExamples(0), temporalRank(0), sampleDeltaMin(0, 0, 0), sampleDeltaStep(0, 0, 0) {}
         ~Input() {}
+
+        bool WaitExample(int s) const
+        {
+            return !waitExample || waitExample(s);
+        }
+        DirectX::XMVECTOR LoadSample(int s, int v) const
+        {
+            if (quantizedSample.empty())
+            {
+                return DirectX::XMLoadFloat3(&sample[s * numVertices + v]);
+            }
+            // oCh_W + ŏl + ʎql * ݕ
+            const unsigned short* q = &quantizedSample[(static_cast<size_t>(s) * numVertices + v) * 3];
+            const DirectX::XMVECTOR delta = DirectX::XMVectorMultiplyAdd(
+                DirectX::XMVectorSet(q[0], q[1], q[2], 0), DirectX::XMLoadFloat3(&sampleDeltaStep), DirectX::XMLoadFloat3(&sampleDeltaMin));
+            return DirectX::XMVectorAdd(LoadBindModel(v), delta);
+        }
+        DirectX::XMVECTOR LoadBindModel(int v) const
+        {
+            return DirectX::XMLoadFloat3(&bindModel[v]);
+        }
     };
 
     // o̓f[^\
@@ -33,6 +72,8 @@ namespace SSDR
         std::vector<int> index;
         //! XLjOsiᎦf[^ x j
         std::vector<RigidTransform> boneTrans;
+        //! œKɗvBCD񐔂̍vi{[ǉEڍדx̍čœK܂݁CNX^O̒ZœK͊܂܂Ȃj
+        int numIterations;
     };
 
     // vZp[^\
@@ -44,8 +85,66 @@ namespace SSDR
         int numIndices;
         //! ő唽
         int numMaxIterations;
+        //! NX^Oɒ_xz{[ɕבւČvZi̓f[^̏ŕבւCIɌɖ߂j
+        bool reorderVertices;
+        //! AndersonɎg𐔁i0ȂȂj
+        int numAccelerationHistory;
+        //! ̋ߎ덷̑ΌʂꖢɂȂCő唽񐔂ɒBOɑł؂i0Ȃł؂Ȃj
+        float convergenceTolerance;
+        //! {[pᎦf[^ɑS{[ɍXViLevenberg-Marquardt@j
+        bool jointBoneUpdate;
+        //! S{[XV̗Ꭶf[^Levenberg-Marquardt
+        int numJointUpdateSteps;
+        //! S{[XVŌ덷ȂꍇɁCW傫ĉ񐔂̏
+        int numJointUpdateTrials;
+        //! EFCgaꖢ̃{[𔽕ɍ폜i0Ȃ폜Ȃj
+        float pruneWeightThreshold;
+        //! SᎦf[^ŉe_̈ʒu̍ȉ̃{[΂𔽕ɓi0Ȃ瓝Ȃj
+        float mergeTolerance;
+        //! ڕWRMS덷Fߎ덷ȉɂȂ܂Ń{[ǉi0ȂnumMinBones̃NX^Ô݁j
+        float targetRmsError;
+        //! {[ǉꍇ̍ő{[
+        int numMaxBones;
+        //! ڍדx̗߂ꍇ́C{[̍čœK̔
+        int numLevelIterations;
+        //! ɎNX^Ǒ␔i1Ȃ猈Iȏ̂݁j
+        int numClusteringStarts;
+        //! NX^Ǒ█ɍsZœK̔
+        int numStartIterations;
+        //! BCD̂ŏ̂̉񐔂́CXLjOEFCg𕡐_܂Ƃ߂Ďˉez@ŋߎIɉi0ȂQPŉj
+        int numBatchedWeightSweeps;
+        //! ˉez@̔
+        int numWeightGradientIterations;
+        //! XLjOEFCgXṼOs{[΂̃[g狁߂i_̌vZʂᎦf[^ɂȂj
+        bool useBonePairMoments;
+
+        Parameter()
+            : numMinBones(16), numIndices(4), numMaxIterations(30),
+            reorderVertices(false), numAccelerationHistory(0), convergenceTolerance(0),
+            jointBoneUpdate(false), numJointUpdateSteps(4), numJointUpdateTrials(4),
+            pruneWeightThreshold(0), mergeTolerance(0),
+            targetRmsError(0), numMaxBones(256), numLevelIterations(15),
+            numClusteringStarts(1), numStartIterations(3),
+            numBatchedWeightSweeps(0), numWeightGradientIterations(50),
+            useBonePairMoments(false)
+        {
+        }
     };
 
-    extern double Decompose(Output& output, const Input& input, const Parameter& param);
+    //! ߎ덷̓aԂiᎦf[^̓ǂݍ݂Ɏsꍇ͕̒lj
+    extern double Decompose(Output& output, Input& input, const Parameter& param);
     extern double ComputeApproximationErrorSq(const Output& output, const Input& input, const Parameter& param);
+    //! Ꭶ`̒_OՂԕ̒᎟̊ɎˉeiSVDj
+    //! ͒_̎ԕςƁCςOՂ̎听Ȃ
+    //! 听͕̎ςaɑ΂^energyRatioȏɂȂŏ̒lƂC
+    //! ˉe덷̓áCςaɑ΂Ԃiǂݍ݂Ɏsꍇ͕̒lj
+    //! ݒ̃XLjOEFCgXV͗Ꭶf[^ł͂ȂɔႷvZʂōsi{[3{ȉ̏ꍇj
+    extern double ComputeTemporalBasis(Input& input, double energyRatio);
+    //! Ꭶ`oCh_W̕ψʂƂ16rbgɗʎqĊi[iǂݍ݂Ɏsꍇ͉̒lԂj
+    //! SᎦf[^ES_̗ʎq덷̓aԂiDecompose̕Ԃߎ덷̓aƓ_ʒu̍̓̑aj
+    //! maxErrorɂ͒_ʒu̍ő덷
+    extern double QuantizeSamples(Input& input, double* maxError = nullptr);
+    //! {[̈قȂڍדx̗1̌vZŋ߂ilevelBonesFeڍדx̍ő{[C~j
+    //! Ꭶf[^̓ǂݍ݂ɎsꍇlevelsɂĕԂ
+    extern void DecomposeLevels(std::vector<Output>& levels, std::vector<double>& errorSq, Input& input, const Parameter& param, const std::vector<int>& levelBones);
 }
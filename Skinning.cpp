@@ -0,0 +1,201 @@
+#include "Skinning.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#ifdef ENABLE_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif //ENABLE_TBB
+
+using namespace DirectX;
+
+// vertices per parallel task
+static const int SkinningGrainSize = 1024;
+
+static void SkinLinearRange(int begin, int end,
+    XMFLOAT3A* position, XMFLOAT3A* normal,
+    const XMFLOAT3A* bindPosition, const XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices,
+    const SkinningPalette& palette)
+{
+    for (int v = begin; v < end; ++v)
+    {
+        // blend the 3x4 matrices first, then transform once
+        XMVECTOR r0 = XMVectorZero(), r1 = XMVectorZero(), r2 = XMVectorZero();
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const float w = weight[v * numIndices + i];
+            if (w == 0)
+            {
+                continue;
+            }
+            const XMVECTOR wv = XMVectorReplicate(w);
+            const XMFLOAT4A* bone = palette.Rows(index[v * numIndices + i]);
+            r0 = XMVectorMultiplyAdd(wv, XMLoadFloat4A(bone + 0), r0);
+            r1 = XMVectorMultiplyAdd(wv, XMLoadFloat4A(bone + 1), r1);
+            r2 = XMVectorMultiplyAdd(wv, XMLoadFloat4A(bone + 2), r2);
+        }
+        // [R | t] rows -> columns, then p' = x * c0 + y * c1 + z * c2 + t
+        XMMATRIX m;
+        m.r[0] = r0;
+        m.r[1] = r1;
+        m.r[2] = r2;
+        m.r[3] = XMVectorZero();
+        m = XMMatrixTranspose(m);
+        XMStoreFloat3A(&position[v], XMVector3Transform(XMLoadFloat3A(&bindPosition[v]), m));
+        if (normal != nullptr)
+        {
+            XMStoreFloat3A(&normal[v], XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3A(&bindNormal[v]), m)));
+        }
+    }
+}
+
+void SkinLinear(XMFLOAT3A* position, XMFLOAT3A* normal,
+    const XMFLOAT3A* bindPosition, const XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices, int numVertices,
+    const SkinningPalette& palette)
+{
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numVertices, SkinningGrainSize),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        SkinLinearRange(range.begin(), range.end(), position, normal, bindPosition, bindNormal, weight, index, numIndices, palette);
+    });
+#else
+    SkinLinearRange(0, numVertices, position, normal, bindPosition, bindNormal, weight, index, numIndices, palette);
+#endif //ENABLE_TBB
+}
+
+static void SkinDualQuaternionRange(int begin, int end,
+    XMFLOAT3A* position, XMFLOAT3A* normal,
+    const XMFLOAT3A* bindPosition, const XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices,
+    const RigidTransform* boneTrans, const XMFLOAT4A* boneDual)
+{
+    for (int v = begin; v < end; ++v)
+    {
+        XMVECTOR real = XMVectorZero(), dual = XMVectorZero();
+        XMVECTOR pivot = XMVectorZero();
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const float w = weight[v * numIndices + i];
+            if (w == 0)
+            {
+                continue;
+            }
+            const int b = index[v * numIndices + i];
+            const XMVECTOR qr = XMLoadFloat4A(&boneTrans[b].Rotation());
+            // blend in the hemisphere of the first influence (antipodality)
+            if (XMVector4Equal(pivot, XMVectorZero()))
+            {
+                pivot = qr;
+            }
+            const XMVECTOR wv = XMVectorReplicate(XMVectorGetX(XMVector4Dot(pivot, qr)) < 0 ? -w : w);
+            real = XMVectorMultiplyAdd(wv, qr, real);
+            dual = XMVectorMultiplyAdd(wv, XMLoadFloat4A(&boneDual[b]), dual);
+        }
+        const XMVECTOR invLength = XMVectorReciprocal(XMVector4Length(real));
+        real = XMVectorMultiply(real, invLength);
+        dual = XMVectorMultiply(dual, invLength);
+        // t = 2 * dual * conj(real)  (XMQuaternionMultiply(a, b) is b * a)
+        const XMVECTOR t = XMVectorScale(XMQuaternionMultiply(XMQuaternionConjugate(real), dual), 2.0f);
+        XMStoreFloat3A(&position[v], XMVectorAdd(XMVector3Rotate(XMLoadFloat3A(&bindPosition[v]), real), t));
+        if (normal != nullptr)
+        {
+            XMStoreFloat3A(&normal[v], XMVector3Rotate(XMLoadFloat3A(&bindNormal[v]), real));
+        }
+    }
+}
+
+void SkinDualQuaternion(XMFLOAT3A* position, XMFLOAT3A* normal,
+    const XMFLOAT3A* bindPosition, const XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones)
+{
+    // dual part 0.5 * t * q of each bone; the real part is the rotation itself
+    std::vector<XMFLOAT4A> boneDual(numBones);
+    for (int b = 0; b < numBones; ++b)
+    {
+        const XMVECTOR t = XMVectorSetW(XMLoadFloat3A(&boneTrans[b].Translation()), 0);
+        XMStoreFloat4A(&boneDual[b], XMVectorScale(XMQuaternionMultiply(XMLoadFloat4A(&boneTrans[b].Rotation()), t), 0.5f));
+    }
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numVertices, SkinningGrainSize),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        SkinDualQuaternionRange(range.begin(), range.end(), position, normal, bindPosition, bindNormal, weight, index, numIndices, boneTrans, boneDual.data());
+    });
+#else
+    SkinDualQuaternionRange(0, numVertices, position, normal, bindPosition, bindNormal, weight, index, numIndices, boneTrans, boneDual.data());
+#endif //ENABLE_TBB
+}
+
+void BenchmarkSkinning(SkinningBenchmarkResult& result, SkinningMode mode,
+    const XMFLOAT3A* bindPosition, const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones, const XMFLOAT3* reference, int numFrames)
+{
+    std::vector<XMFLOAT3A> position(numVertices);
+    SkinningPalette palette;
+    double errsq = 0;
+    result.seconds = 0;
+    result.maxError = 0;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (mode == SkinningModeDualQuaternion)
+        {
+            SkinDualQuaternion(position.data(), nullptr, bindPosition, nullptr, weight, index, numIndices, numVertices, boneTrans + f * numBones, numBones);
+        }
+        else
+        {
+            palette.Set(boneTrans + f * numBones, numBones);
+            SkinLinear(position.data(), nullptr, bindPosition, nullptr, weight, index, numIndices, numVertices, palette);
+        }
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const float e = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3A(&position[v]) - XMLoadFloat3(&reference[f * numVertices + v])));
+            errsq += e;
+            result.maxError = std::max(result.maxError, static_cast<double>(e));
+        }
+    }
+    result.maxError = std::sqrt(result.maxError);
+    result.rmsError = (numFrames * numVertices > 0) ? std::sqrt(errsq / (static_cast<double>(numFrames) * numVertices)) : 0;
+}
+
+static void ComputeSkinningErrorFrames(int begin, int end, unsigned char* table, float upperBound,
+    const XMFLOAT3A* bindPosition, const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones, const XMFLOAT3* reference)
+{
+    std::vector<XMFLOAT3A> position(numVertices);
+    SkinningPalette palette;
+    const float scale = 255.0f / upperBound;
+    for (int f = begin; f < end; ++f)
+    {
+        palette.Set(boneTrans + f * numBones, numBones);
+        SkinLinearRange(0, numVertices, position.data(), nullptr, bindPosition, nullptr, weight, index, numIndices, palette);
+        for (int v = 0; v < numVertices; ++v)
+        {
+            const float e = XMVectorGetX(XMVector3Length(XMLoadFloat3A(&position[v]) - XMLoadFloat3(&reference[f * numVertices + v])));
+            table[f * numVertices + v] = static_cast<unsigned char>(std::min(e * scale + 0.5f, 255.0f));
+        }
+    }
+}
+
+void ComputeSkinningErrorTable(std::vector<unsigned char>& table, float upperBound,
+    const XMFLOAT3A* bindPosition, const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones, const XMFLOAT3* reference, int numFrames)
+{
+    assert(upperBound > 0 && "ComputeSkinningErrorTable(): upperBound must be positive.");
+    table.resize(static_cast<size_t>(numFrames) * numVertices);
+#ifdef ENABLE_TBB
+    tbb::parallel_for(tbb::blocked_range<int>(0, numFrames),
+        [&](const tbb::blocked_range<int>& range)
+    {
+        ComputeSkinningErrorFrames(range.begin(), range.end(), table.data(), upperBound, bindPosition, weight, index, numIndices, numVertices, boneTrans, numBones, reference);
+    });
+#else
+    ComputeSkinningErrorFrames(0, numFrames, table.data(), upperBound, bindPosition, weight, index, numIndices, numVertices, boneTrans, numBones, reference);
+#endif //ENABLE_TBB
+}
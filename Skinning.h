@@ -0,0 +1,171 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "RigidTransform.h"
+
+// Bone palette for CPU skinning and for the SSDR solver.
+// Each bone is a 3x4 row-major matrix [R | t] stored as three consecutive
+// 16-byte rows, so blending a vertex touches one contiguous 48-byte block per influence.
+// The palette is deliberately kept array-of-structures rather than split into x/y/z
+// planes: skinning and most solver loops look up a few arbitrary bones per vertex, and
+// the loops that sweep many bones for one point use the batched TransformCoord instead.
+// Update keeps a copy of the source transforms and only rebuilds the bones that changed.
+class SkinningPalette
+{
+public:
+    SkinningPalette()
+        : numBones(0)
+    {
+    }
+
+public:
+    void Set(const RigidTransform* boneTrans, int numBones_)
+    {
+        numBones = numBones_;
+        rows.resize(numBones * 3);
+        source.resize(numBones);
+        for (int b = 0; b < numBones; ++b)
+        {
+            Set(b, boneTrans[b]);
+        }
+    }
+    // refreshes the bones whose transform differs from the cached one; returns how many changed
+    int Update(const RigidTransform* boneTrans, int numBones_)
+    {
+        if (numBones_ != numBones)
+        {
+            Set(boneTrans, numBones_);
+            return numBones;
+        }
+        int numChanged = 0;
+        for (int b = 0; b < numBones; ++b)
+        {
+            if (!Equal(source[b], boneTrans[b]))
+            {
+                Set(b, boneTrans[b]);
+                ++numChanged;
+            }
+        }
+        return numChanged;
+    }
+    int Update(const std::vector<RigidTransform>& boneTrans)
+    {
+        return Update(boneTrans.data(), static_cast<int>(boneTrans.size()));
+    }
+    // refreshes a single bone (bones may be set concurrently from different threads)
+    void Set(int bone, const RigidTransform& boneTrans)
+    {
+        source[bone] = boneTrans;
+        DirectX::XMMATRIX m = DirectX::XMMatrixTranspose(DirectX::XMMatrixRotationQuaternion(DirectX::XMLoadFloat4A(&boneTrans.Rotation())));
+        DirectX::XMStoreFloat4A(&rows[bone * 3 + 0], DirectX::XMVectorSetW(m.r[0], boneTrans.Translation().x));
+        DirectX::XMStoreFloat4A(&rows[bone * 3 + 1], DirectX::XMVectorSetW(m.r[1], boneTrans.Translation().y));
+        DirectX::XMStoreFloat4A(&rows[bone * 3 + 2], DirectX::XMVectorSetW(m.r[2], boneTrans.Translation().z));
+    }
+    int NumBones() const
+    {
+        return numBones;
+    }
+    const DirectX::XMFLOAT4A* Rows(int bone) const
+    {
+        return &rows[bone * 3];
+    }
+
+    // p R + t (row vector, same as RigidTransform::TransformCoord), one row dot product per component
+    DirectX::XMVECTOR TransformCoord(int bone, DirectX::FXMVECTOR p) const
+    {
+        DirectX::XMFLOAT3 q;
+        DirectX::XMStoreFloat3(&q, p);
+        const DirectX::XMFLOAT4A* r = &rows[bone * 3];
+        return DirectX::XMVectorSet(
+            q.x * r[0].x + q.y * r[0].y + q.z * r[0].z + r[0].w,
+            q.x * r[1].x + q.y * r[1].y + q.z * r[1].z + r[1].w,
+            q.x * r[2].x + q.y * r[2].y + q.z * r[2].z + r[2].w,
+            1.0f);
+    }
+    // p R
+    DirectX::XMVECTOR Rotate(int bone, DirectX::FXMVECTOR p) const
+    {
+        DirectX::XMFLOAT3 q;
+        DirectX::XMStoreFloat3(&q, p);
+        const DirectX::XMFLOAT4A* r = &rows[bone * 3];
+        return DirectX::XMVectorSet(
+            q.x * r[0].x + q.y * r[0].y + q.z * r[0].z,
+            q.x * r[1].x + q.y * r[1].y + q.z * r[1].z,
+            q.x * r[2].x + q.y * r[2].y + q.z * r[2].z,
+            0.0f);
+    }
+    // transforms p by bones [first, first + count) into x/y/z[0 .. count)
+    void TransformCoord(float* x, float* y, float* z, int first, int count, const DirectX::XMFLOAT3& p) const
+    {
+        const DirectX::XMFLOAT4A* r = &rows[first * 3];
+        for (int j = 0; j < count; ++j, r += 3)
+        {
+            x[j] = p.x * r[0].x + p.y * r[0].y + p.z * r[0].z + r[0].w;
+            y[j] = p.x * r[1].x + p.y * r[1].y + p.z * r[1].z + r[1].w;
+            z[j] = p.x * r[2].x + p.y * r[2].y + p.z * r[2].z + r[2].w;
+        }
+    }
+
+private:
+    // compares the members (XMFLOAT3A has padding, so memcmp is not reliable)
+    static bool Equal(const RigidTransform& a, const RigidTransform& b)
+    {
+        const DirectX::XMFLOAT4A& qa = a.Rotation();
+        const DirectX::XMFLOAT4A& qb = b.Rotation();
+        const DirectX::XMFLOAT3A& ta = a.Translation();
+        const DirectX::XMFLOAT3A& tb = b.Translation();
+        return qa.x == qb.x && qa.y == qb.y && qa.z == qb.z && qa.w == qb.w
+            && ta.x == tb.x && ta.y == tb.y && ta.z == tb.z;
+    }
+
+    std::vector<DirectX::XMFLOAT4A> rows;
+    std::vector<RigidTransform> source;
+    int numBones;
+};
+
+enum SkinningMode
+{
+    SkinningModeLinear,
+    SkinningModeDualQuaternion
+};
+
+struct SkinningBenchmarkResult
+{
+    //! seconds spent skinning all frames (error evaluation excluded)
+    double seconds;
+    //! error against the reference frames
+    double rmsError;
+    double maxError;
+};
+
+// Linear blend skinning of a whole mesh.
+// weight/index hold numIndices entries per vertex (the SSDR::Output layout);
+// normals are optional (pass nullptr to skip them).
+extern void SkinLinear(DirectX::XMFLOAT3A* position, DirectX::XMFLOAT3A* normal,
+    const DirectX::XMFLOAT3A* bindPosition, const DirectX::XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices, int numVertices,
+    const SkinningPalette& palette);
+
+// Dual quaternion skinning of a whole mesh, blending the RigidTransform
+// rotation/translation pairs directly.
+extern void SkinDualQuaternion(DirectX::XMFLOAT3A* position, DirectX::XMFLOAT3A* normal,
+    const DirectX::XMFLOAT3A* bindPosition, const DirectX::XMFLOAT3A* bindNormal,
+    const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones);
+
+// Skins every frame of boneTrans (numFrames x numBones) with the given mode
+// and compares against reference (numFrames x numVertices).
+extern void BenchmarkSkinning(SkinningBenchmarkResult& result, SkinningMode mode,
+    const DirectX::XMFLOAT3A* bindPosition, const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones, const DirectX::XMFLOAT3* reference, int numFrames);
+
+// Per-frame linear blend skinning error, quantised to 8 bits against
+// upperBound (0 = exact, 255 = upperBound or more); numFrames x numVertices.
+extern void ComputeSkinningErrorTable(std::vector<unsigned char>& table, float upperBound,
+    const DirectX::XMFLOAT3A* bindPosition, const float* weight, const int* index, int numIndices, int numVertices,
+    const RigidTransform* boneTrans, int numBones, const DirectX::XMFLOAT3* reference, int numFrames);
+
+#endif //SKINNING_H
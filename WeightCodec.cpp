@@ -0,0 +1,129 @@
+#include "WeightCodec.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SSDR
+{
+    // quantises the weights of one vertex to integers summing to maxValue
+    template <typename T>
+    static void QuantizeWeights(T* dst, const float* src, int numIndices, unsigned int maxValue)
+    {
+        const int MaxIndices = 64;
+        float remainder[MaxIndices];
+        double sum = 0;
+        for (int i = 0; i < numIndices; ++i)
+        {
+            sum += std::max(src[i], 0.0f);
+        }
+        if (sum <= 0)
+        {
+            std::fill(dst, dst + numIndices, T(0));
+            dst[0] = static_cast<T>(maxValue);
+            return;
+        }
+        const double scale = maxValue / sum;
+        unsigned int total = 0;
+        for (int i = 0; i < numIndices; ++i)
+        {
+            const double q = std::max(src[i], 0.0f) * scale;
+            const unsigned int whole = static_cast<unsigned int>(q);
+            dst[i] = static_cast<T>(whole);
+            remainder[i] = static_cast<float>(q - whole);
+            total += whole;
+        }
+        // largest remainder: hand out the missing units one by one
+        for (; total < maxValue; ++total)
+        {
+            const int i = static_cast<int>(std::max_element(remainder, remainder + numIndices) - remainder);
+            ++dst[i];
+            remainder[i] = -1.0f;
+        }
+    }
+
+    template <typename T>
+    static void EncodeWeights(std::vector<T>& dst, SkinCodecError* error, const std::vector<float>& src, int numIndices)
+    {
+        const unsigned int maxValue = (1u << (sizeof(T) * 8)) - 1;
+        const float invMaxValue = 1.0f / maxValue;
+        dst.resize(src.size());
+        double errsq = 0, maxError = 0;
+        for (size_t v = 0; v < src.size(); v += numIndices)
+        {
+            QuantizeWeights(&dst[v], &src[v], numIndices, maxValue);
+            for (int i = 0; i < numIndices; ++i)
+            {
+                const double e = std::abs(dst[v + i] * invMaxValue - src[v + i]);
+                errsq += e * e;
+                maxError = std::max(maxError, e);
+            }
+        }
+        if (error != nullptr)
+        {
+            error->maxWeightError = maxError;
+            error->rmsWeightError = src.empty() ? 0 : std::sqrt(errsq / src.size());
+        }
+    }
+
+    template <typename T>
+    static void DecodeWeights(std::vector<float>& dst, const std::vector<T>& src)
+    {
+        const float invMaxValue = 1.0f / ((1u << (sizeof(T) * 8)) - 1);
+        dst.resize(src.size());
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            dst[i] = src[i] * invMaxValue;
+        }
+    }
+
+    bool EncodeSkin(CompressedSkin& skin, SkinCodecError* error, const Output& output, const Parameter& param, int weightBits)
+    {
+        if ((weightBits != 8 && weightBits != 16) || output.numBones > 65536 || param.numIndices <= 0 || param.numIndices > 64)
+        {
+            return false;
+        }
+        skin = CompressedSkin();
+        skin.numIndices = param.numIndices;
+        skin.numVertices = static_cast<int>(output.weight.size() / param.numIndices);
+        skin.numBones = output.numBones;
+        skin.weightBits = weightBits;
+        skin.indexBits = (output.numBones <= 256) ? 8 : 16;
+
+        if (weightBits == 8)
+        {
+            EncodeWeights(skin.weight8, error, output.weight, param.numIndices);
+        }
+        else
+        {
+            EncodeWeights(skin.weight16, error, output.weight, param.numIndices);
+        }
+        if (skin.indexBits == 8)
+        {
+            skin.index8.assign(output.index.begin(), output.index.end());
+        }
+        else
+        {
+            skin.index16.assign(output.index.begin(), output.index.end());
+        }
+        return true;
+    }
+
+    void DecodeSkin(std::vector<float>& weight, std::vector<int>& index, const CompressedSkin& skin)
+    {
+        if (skin.weightBits == 8)
+        {
+            DecodeWeights(weight, skin.weight8);
+        }
+        else
+        {
+            DecodeWeights(weight, skin.weight16);
+        }
+        if (skin.indexBits == 8)
+        {
+            index.assign(skin.index8.begin(), skin.index8.end());
+        }
+        else
+        {
+            index.assign(skin.index16.begin(), skin.index16.end());
+        }
+    }
+}
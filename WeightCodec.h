@@ -0,0 +1,51 @@
+#ifndef WEIGHT_CODEC_H
+#define WEIGHT_CODEC_H
+#pragma once
+
+#include <vector>
+#include "SSDR.h"
+
+namespace SSDR
+{
+    // Compact skinning weights/indices in the Output layout (numVertices x numIndices).
+    //
+    // Weights are fixed point with 8 or 16 bits; the quantised weights of each
+    // vertex are distributed by largest remainder so they sum to exactly one.
+    // Indices use 8 bits up to 256 bones and 16 bits otherwise.
+    // Only the vectors matching weightBits/indexBits are populated.
+    struct CompressedSkin
+    {
+        int numVertices;
+        int numIndices;
+        int numBones;
+        int weightBits;
+        int indexBits;
+        std::vector<unsigned char> weight8;
+        std::vector<unsigned short> weight16;
+        std::vector<unsigned char> index8;
+        std::vector<unsigned short> index16;
+
+        CompressedSkin()
+            : numVertices(0), numIndices(0), numBones(0), weightBits(0), indexBits(0)
+        {
+        }
+        size_t SizeInBytes() const
+        {
+            return weight8.size() + weight16.size() * sizeof(unsigned short)
+                + index8.size() + index16.size() * sizeof(unsigned short);
+        }
+    };
+
+    // weight error introduced by the encoding
+    struct SkinCodecError
+    {
+        double maxWeightError;
+        double rmsWeightError;
+    };
+
+    // weightBits is 8 or 16; returns false for other widths or more than 65536 bones
+    extern bool EncodeSkin(CompressedSkin& skin, SkinCodecError* error, const Output& output, const Parameter& param, int weightBits);
+    extern void DecodeSkin(std::vector<float>& weight, std::vector<int>& index, const CompressedSkin& skin);
+}
+
+#endif //WEIGHT_CODEC_H
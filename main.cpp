@@ -8,6 +8,12 @@ int _tmain(int argc, _TCHAR* argv[])
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+    // "DemoSSDR -convert" only rebuilds the mesh sequence cache and exits
+    if (argc > 1 && _tcscmp(argv[1], _T("-convert")) == 0)
+    {
+        return HorseObject::ConvertSequence() ? 0 : 1;
+    }
+
     SampleApp::Config config;
     config.title = L"DemoSSDR";
 
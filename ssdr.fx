@@ -12,6 +12,7 @@ cbuffer CBPerObj : register(b1)
     float3 localLightPos;
     float4 ambientColor;
     float  specExpon;
+    uint   errorOffset;
 };
 
 cbuffer CBSkinningMatrix : register(b2)
@@ -19,6 +20,9 @@ cbuffer CBSkinningMatrix : register(b2)
     matrix pallet[100];
 }
 
+// per-frame reconstruction error (frames x vertices, 0..1 of the upper bound)
+Buffer<float> errorTable : register(t0);
+
 struct VertexData
 {
     float3 position : POSITION;
@@ -57,7 +61,7 @@ float3 BlendNormal(float4 weight, uint4 index, float3 n)
     return output.xyz;
 }
 
-LambertData LambertSkinVS(VertexData input)
+LambertData LambertSkinVS(VertexData input, uint vertexId : SV_VertexID)
 {
     LambertData output = (LambertData)0;
     output.position = BlendPosition(input.weight, input.index, input.position);
@@ -67,7 +71,8 @@ LambertData LambertSkinVS(VertexData input)
     output.normal = BlendNormal(input.weight, input.index, input.normal.xyz);
     output.viewVec = normalize(localEyePos - input.position);
     output.lightVec = normalize(localLightPos - input.position);
-    output.color = input.color;
+    float err = errorTable.Load(errorOffset + vertexId);
+    output.color = float4(1.0f, 1.0f - err, 1.0f - err, input.color.w);
     return output;
 }
 
@@ -1,97 +1,312 @@
 #include "util.h"
 #include <cstdio>
-
-static const char* delim = " /\t\n";
-static char* context = nullptr;
+#include <cmath>
 
 using namespace DirectX;
 
-bool ReadVector3(XMFLOAT3& v, char* buf)
+// read-only view of a whole file; released on scope exit
+class MappedFile
 {
-    // local definition
-    //
-#define READ_VECTOR3_TOKEN(ELEMENT) tok = strtok_s(buf, delim, &context); \
-    if (tok == nullptr) { return false; } \
-    v.ELEMENT = static_cast<float>(std::atof(tok));
-    //
-    char* tok = nullptr;
-    READ_VECTOR3_TOKEN(x);
-    READ_VECTOR3_TOKEN(y);
-    READ_VECTOR3_TOKEN(z);
-    return true;
+public:
+    explicit MappedFile(const std::wstring& filePath)
+        : file(INVALID_HANDLE_VALUE), mapping(nullptr), data(nullptr), size(0)
+    {
+        file = CreateFileW(filePath.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            return;
+        }
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            return;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data != nullptr)
+        {
+            size = static_cast<size_t>(fileSize.QuadPart);
+        }
+    }
+    ~MappedFile()
+    {
+        if (data != nullptr)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != nullptr)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+    }
+    const char* Begin() const
+    {
+        return data;
+    }
+    const char* End() const
+    {
+        return data + size;
+    }
+    bool IsOpen() const
+    {
+        return data != nullptr;
+    }
+
+private:
+    HANDLE file;
+    HANDLE mapping;
+    const char* data;
+    size_t size;
+
+private:
+    MappedFile(const MappedFile& src);
+    void operator =(const MappedFile& src);
+};
+
+static inline bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
 }
 
-bool LoadObjFile(std::vector<XMFLOAT3A>& position, std::vector<DWORD>& index, const std::wstring& filePath, float scale)
+static inline bool IsDigit(char c)
 {
-    char buf[1024];
-    char* tok = nullptr;
+    return c >= '0' && c <= '9';
+}
 
-    FILE* fin = nullptr;
-    _wfopen_s(&fin, filePath.data(), L"r");
-    if (fin == nullptr)
+static inline const char* SkipBlank(const char* p, const char* end)
+{
+    while (p != end && IsBlank(*p))
     {
-        return false;
+        ++p;
     }
+    return p;
+}
 
-    position.clear();
-    index.clear();
+static inline const char* NextLine(const char* p, const char* end)
+{
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol == nullptr ? end : eol + 1;
+}
 
-    while (std::fgets(buf, 1024, fin) != nullptr)
+// locale-independent decimal parser ([+-]digits[.digits][(e|E)[+-]digits])
+static bool ParseFloat(const char*& p, const char* end, float& value)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* s = p;
+    bool negative = false;
+    if (s != end && (*s == '-' || *s == '+'))
     {
-        tok = strtok_s(buf, delim, &context);
-        if (tok == nullptr)
+        negative = (*s == '-');
+        ++s;
+    }
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int numDigits = 0;
+    int numSignificant = 0;
+    for (; s != end && IsDigit(*s); ++s, ++numDigits)
+    {
+        if (numSignificant < 19)
         {
+            mantissa = mantissa * 10 + (*s - '0');
+            numSignificant += (mantissa != 0);
         }
-        else if (tok[0] == '#')
+        else
         {
-            continue;
+            ++exponent;
         }
-        else if (strcmp(tok, "v") == 0)
+    }
+    if (s != end && *s == '.')
+    {
+        for (++s; s != end && IsDigit(*s); ++s, ++numDigits)
         {
-            XMFLOAT3 p;
-            if (!ReadVector3(p, NULL))
+            if (numSignificant < 19)
             {
-                break;
+                mantissa = mantissa * 10 + (*s - '0');
+                numSignificant += (mantissa != 0);
+                --exponent;
             }
-            position.push_back(XMFLOAT3A(p.x * scale, p.y * scale, p.z * scale));
         }
-        else if (strcmp(tok, "vt") == 0)
+    }
+    if (numDigits == 0)
+    {
+        return false;
+    }
+    if (s != end && (*s == 'e' || *s == 'E'))
+    {
+        const char* e = s + 1;
+        bool negativeExp = false;
+        if (e != end && (*e == '-' || *e == '+'))
         {
-            continue;
+            negativeExp = (*e == '-');
+            ++e;
         }
-        else if (strcmp(tok, "f") == 0)
+        if (e != end && IsDigit(*e))
         {
-            std::vector<unsigned int > tmp;
-            while (tok = strtok_s(NULL, delim, &context), tok != nullptr)
-            {
-                tmp.push_back(static_cast<unsigned int >(atol(tok) - 1));
-            }
-            switch (tmp.size())
+            int exp = 0;
+            for (; e != end && IsDigit(*e); ++e)
             {
-            case 6:
-                index.push_back(tmp[0]);
-                index.push_back(tmp[2]);
-                index.push_back(tmp[4]);
-                break;
-            default:
-                fclose(fin);
-                position.clear();
-                index.clear();
-                return false;
-                break;
+                if (exp < 10000)
+                {
+                    exp = exp * 10 + (*e - '0');
+                }
             }
+            exponent += negativeExp ? -exp : exp;
+            s = e;
+        }
+    }
+
+    double d = static_cast<double>(mantissa);
+    if (exponent < 0)
+    {
+        d = (exponent >= -22) ? d / pow10[-exponent] : d * std::pow(10.0, exponent);
+    }
+    else if (exponent > 0)
+    {
+        d = (exponent <= 22) ? d * pow10[exponent] : d * std::pow(10.0, exponent);
+    }
+    value = static_cast<float>(negative ? -d : d);
+    p = s;
+    return true;
+}
+
+static bool ParseInt(const char*& p, const char* end, long& value)
+{
+    const char* s = p;
+    bool negative = false;
+    if (s != end && (*s == '-' || *s == '+'))
+    {
+        negative = (*s == '-');
+        ++s;
+    }
+    if (s == end || !IsDigit(*s))
+    {
+        return false;
+    }
+    long v = 0;
+    for (; s != end && IsDigit(*s); ++s)
+    {
+        v = v * 10 + (*s - '0');
+    }
+    value = negative ? -v : v;
+    p = s;
+    return true;
+}
+
+// v, v/vt, v//vn, v/vt/vn (1-based or negative relative indices)
+static bool ParseFaceVertex(const char*& p, const char* end, size_t numPositions, DWORD& index)
+{
+    long v = 0;
+    if (!ParseInt(p, end, v) || v == 0)
+    {
+        return false;
+    }
+    if (v < 0)
+    {
+        if (static_cast<size_t>(-v) > numPositions)
+        {
+            return false;
         }
-        else if (strcmp(tok, "g") == 0)
+        index = static_cast<DWORD>(numPositions + v);
+    }
+    else
+    {
+        index = static_cast<DWORD>(v - 1);
+    }
+    for (int slash = 0; slash < 2 && p != end && *p == '/'; ++slash)
+    {
+        ++p;
+        long ignored = 0;
+        ParseInt(p, end, ignored);
+    }
+    return p == end || IsBlank(*p) || *p == '\n' || *p == '#';
+}
+
+bool LoadObjFile(std::vector<XMFLOAT3A>& position, std::vector<DWORD>& index, const std::wstring& filePath, float scale)
+{
+    position.clear();
+    index.clear();
+
+    MappedFile file(filePath);
+    if (!file.IsOpen())
+    {
+        return false;
+    }
+    const char* const begin = file.Begin();
+    const char* const end = file.End();
+
+    // pre-size the outputs from a cheap scan of the line heads
+    size_t numPositions = 0, numFaces = 0;
+    for (const char* p = begin; p != end; p = NextLine(p, end))
+    {
+        const char* s = SkipBlank(p, end);
+        if (end - s >= 2 && IsBlank(s[1]))
         {
-            continue;
+            numPositions += (s[0] == 'v');
+            numFaces += (s[0] == 'f');
         }
-        else
+    }
+    position.reserve(numPositions);
+    index.reserve(numFaces * 3);
+
+    std::vector<DWORD> polygon;
+    bool retval = true;
+    for (const char* p = begin; retval && p != end; p = NextLine(p, end))
+    {
+        const char* s = SkipBlank(p, end);
+        if (end - s < 2 || !IsBlank(s[1]))
         {
+            // comments, vt, vn, g, usemtl, ...
             continue;
         }
+        if (s[0] == 'v')
+        {
+            XMFLOAT3A v;
+            s = SkipBlank(s + 1, end);
+            retval = ParseFloat(s, end, v.x);
+            s = SkipBlank(s, end);
+            retval = retval && ParseFloat(s, end, v.y);
+            s = SkipBlank(s, end);
+            retval = retval && ParseFloat(s, end, v.z);
+            position.push_back(XMFLOAT3A(v.x * scale, v.y * scale, v.z * scale));
+        }
+        else if (s[0] == 'f')
+        {
+            polygon.clear();
+            s = SkipBlank(s + 1, end);
+            while (retval && s != end && *s != '\n' && *s != '#')
+            {
+                DWORD v = 0;
+                retval = ParseFaceVertex(s, end, position.size(), v);
+                polygon.push_back(v);
+                s = SkipBlank(s, end);
+            }
+            retval = retval && polygon.size() >= 3;
+            // triangle fan
+            for (size_t i = 2; retval && i < polygon.size(); ++i)
+            {
+                index.push_back(polygon[0]);
+                index.push_back(polygon[i - 1]);
+                index.push_back(polygon[i]);
+            }
+        }
     }
-    fclose(fin);
-    return true;
+    if (!retval)
+    {
+        position.clear();
+        index.clear();
+    }
+    return retval;
 }
 
 bool ComputeNormal(std::vector<XMFLOAT3A>& normal, const std::vector<XMFLOAT3A>& position, const std::vector<DWORD>& index)